@@ -0,0 +1,173 @@
+/** @file
+ *  @brief am2320 I2C emulator
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define DT_DRV_COMPAT aosong_am2320_emul
+
+#include <device.h>
+#include <drivers/emul.h>
+#include <drivers/i2c.h>
+#include <drivers/i2c_emul.h>
+#include <kernel.h>
+#include <string.h>
+
+#include "env_scenario.h"
+
+#define CMD_READREG     0x03
+#define NB_REG          0x20
+#define REG_HUM_H       0x00
+#define REG_TEMP_H      0x02
+#define MAX_READ_LEN    10
+#define AWAKE_TIME_MS   3000   // sensor falls back asleep ~3 s after wake-up
+#define REPLY_DELAY_US  1500   // minimum delay between command and read
+
+struct am2320_emul_data {
+    struct i2c_emul emul_i2c;
+    int64_t awake_until;    // ms, 0 when asleep
+    int64_t reply_ready;    // us, 0 when no command is pending
+    uint8_t reply[MAX_READ_LEN + 4];
+    uint8_t reply_len;
+};
+
+struct am2320_emul_cfg {
+    const char *label;
+    struct am2320_emul_data *data;
+    uint16_t addr;
+};
+
+/**
+ * @brief Modbus CRC16, same polynomial as the driver
+ */
+static uint16_t am2320_emul_crc16(const uint8_t *buffer, uint8_t nbytes) {
+    uint16_t crc = 0xffff;
+    for (int i = 0; i < nbytes; i++) {
+        crc ^= buffer[i];
+        for (int x = 0; x < 8; x++) {
+            if (crc & 0x0001) {
+                crc = (crc >> 1) ^ 0xA001;
+            } else {
+                crc >>= 1;
+            }
+        }
+    }
+    return crc;
+}
+
+/**
+ * @brief Fill the register file from the simulated conditions
+ *
+ * Humidity is in 0.1 %RH, temperature in 0.1 degC sign/magnitude, big endian.
+ */
+static void am2320_emul_sample(uint8_t *regs) {
+    env_sample_t env;
+    uint16_t hum, temp;
+
+    env_scenario_get(&env);
+    hum = CLAMP(env.humidity, 0, 10000) / 10;
+    temp = (env.temperature < 0) ? (0x8000 | (-env.temperature / 10)) : (env.temperature / 10);
+
+    memset(regs, 0, NB_REG);
+    regs[REG_HUM_H] = hum >> 8;
+    regs[REG_HUM_H + 1] = hum & 0xFF;
+    regs[REG_TEMP_H] = temp >> 8;
+    regs[REG_TEMP_H + 1] = temp & 0xFF;
+    regs[0x08] = 0x03;   // model high byte
+    regs[0x09] = 0x20;   // model low byte
+    regs[0x0A] = 0x01;   // version
+}
+
+/**
+ * @brief Decode a function code 0x03 request and prepare the reply
+ */
+static int am2320_emul_command(struct am2320_emul_data *data, const uint8_t *buf, uint32_t len) {
+    uint8_t regs[NB_REG];
+    uint16_t crc;
+
+    if (len < 3 || buf[0] != CMD_READREG || buf[2] == 0 || buf[2] > MAX_READ_LEN || buf[1] + buf[2] > NB_REG) {
+        return -EIO;
+    }
+    am2320_emul_sample(regs);
+    data->reply[0] = CMD_READREG;
+    data->reply[1] = buf[2];
+    memcpy(&data->reply[2], &regs[buf[1]], buf[2]);
+    crc = am2320_emul_crc16(data->reply, buf[2] + 2);
+    data->reply[buf[2] + 2] = crc & 0xFF;
+    data->reply[buf[2] + 3] = crc >> 8;
+    data->reply_len = buf[2] + 4;
+    data->reply_ready = k_ticks_to_us_floor64(k_uptime_ticks()) + REPLY_DELAY_US;
+    return 0;
+}
+
+static int am2320_emul_transfer(struct i2c_emul *emul, struct i2c_msg *msgs, int num_msgs, int addr) {
+    struct am2320_emul_data *data = CONTAINER_OF(emul, struct am2320_emul_data, emul_i2c);
+    int64_t now = k_uptime_get();
+
+    env_bus_delay(msgs, num_msgs);
+    if (!env_scenario_sensor_present(ENV_SENSOR_AM2320)) {
+        return -EIO;
+    }
+
+    // Asleep: the address is not acknowledged but the sensor wakes up
+    if (now >= data->awake_until) {
+        data->awake_until = now + AWAKE_TIME_MS;
+        data->reply_ready = 0;
+        return -EIO;
+    }
+
+    for (int i = 0; i < num_msgs; i++) {
+        if (msgs[i].flags & I2C_MSG_READ) {
+            // Awake with no command pending: like the real sensor the address
+            // is acknowledged and the released bus reads 0xFF. i2c_probe()
+            // finds the AM2320 this way.
+            if (!data->reply_ready) {
+                memset(msgs[i].buf, 0xFF, msgs[i].len);
+                continue;
+            }
+            if (k_ticks_to_us_floor64(k_uptime_ticks()) < data->reply_ready) {
+                return -EIO;
+            }
+            for (int j = 0; j < msgs[i].len; j++) {
+                msgs[i].buf[j] = (j < data->reply_len) ? data->reply[j] : 0xFF;
+            }
+            data->reply_ready = 0;
+        } else if (msgs[i].len > 1) {
+            if (am2320_emul_command(data, msgs[i].buf, msgs[i].len) != 0) {
+                return -EIO;
+            }
+        }
+    }
+    return 0;
+}
+
+static struct i2c_emul_api am2320_emul_api_i2c = {
+    .transfer = am2320_emul_transfer,
+};
+
+static int am2320_emul_init(const struct emul *emul, const struct device *parent) {
+    const struct am2320_emul_cfg *cfg = emul->cfg;
+    struct am2320_emul_data *data = cfg->data;
+
+    data->emul_i2c.api = &am2320_emul_api_i2c;
+    data->emul_i2c.addr = cfg->addr;
+    data->awake_until = 0;
+    data->reply_ready = 0;
+
+    return i2c_emul_register(parent, emul->dev_label, &data->emul_i2c);
+}
+
+#define AM2320_EMUL(n)                                                                                                                                         \
+    static struct am2320_emul_data am2320_emul_data_##n;                                                                                                       \
+    static const struct am2320_emul_cfg am2320_emul_cfg_##n = {                                                                                                \
+        .label = DT_INST_LABEL(n),                                                                                                                             \
+        .data = &am2320_emul_data_##n,                                                                                                                         \
+        .addr = DT_INST_REG_ADDR(n),                                                                                                                           \
+    };                                                                                                                                                         \
+    EMUL_DEFINE(am2320_emul_init, DT_DRV_INST(n), &am2320_emul_cfg_##n)
+
+DT_INST_FOREACH_STATUS_OKAY(AM2320_EMUL)
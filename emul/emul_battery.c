@@ -0,0 +1,42 @@
+/** @file
+ *  @brief Battery voltage source for the ADC emulator
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <device.h>
+#include <drivers/adc.h>
+#include <drivers/adc/adc_emul.h>
+#include <init.h>
+#include <kernel.h>
+
+#include "env_scenario.h"
+
+#ifdef CONFIG_ADC_EMUL
+
+#define ADC_NODE DT_NODELABEL(adc)
+
+static int battery_emul_value(const struct device *dev, unsigned int chan, void *data, uint32_t *result) {
+    env_sample_t env;
+
+    env_scenario_get(&env);
+    *result = env.battery;
+    return 0;
+}
+
+static int battery_emul_init(const struct device *unused) {
+    const struct device *adc = device_get_binding(DT_LABEL(ADC_NODE));
+
+    if (adc == NULL) {
+        return -ENODEV;
+    }
+    return adc_emul_value_func_set(adc, 0, battery_emul_value, NULL);
+}
+
+SYS_INIT(battery_emul_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+#endif
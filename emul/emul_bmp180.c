@@ -0,0 +1,255 @@
+/** @file
+ *  @brief Bmp180 I2C emulator
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#define DT_DRV_COMPAT bosch_bmp180_emul
+
+#include <device.h>
+#include <drivers/emul.h>
+#include <drivers/i2c.h>
+#include <drivers/i2c_emul.h>
+#include <kernel.h>
+#include <string.h>
+
+#include "env_scenario.h"
+
+// Registers
+#define CALIB     0xAA
+#define ID        0xD0
+#define SOFT      0xE0
+#define CTRL_MEAS 0xF4
+#define OUT_MSB   0xF6
+
+#define CHIP_ID     0x55
+#define SOFT_RESET  0xB6
+#define CTRL_SCO    0x20
+#define CMD_TEMP    0x2E
+#define CMD_PRESS   0x34
+#define T_CONV_TEMP 4500   // us
+
+// Datasheet example calibration (BMP180 datasheet, chapter 3.5)
+static const int16_t calib[11] = {408, -72, -14383, 32741, 32757, 23153, 6190, 4, -32768, -8711, 2868};
+static const uint16_t t_conv_press[4] = {4500, 7500, 13500, 25500};   // us, per oss
+
+struct bmp180_emul_data {
+    struct i2c_emul emul_i2c;
+    uint8_t reg[256];
+    uint8_t ptr;
+    uint8_t pending[3];      // result latched when the conversion completes
+    int64_t conv_done_us;    // 0 when no conversion is running
+};
+
+struct bmp180_emul_cfg {
+    const char *label;
+    struct bmp180_emul_data *data;
+    uint16_t addr;
+};
+
+#define AC1 calib[0]
+#define AC2 calib[1]
+#define AC3 calib[2]
+#define AC4 ((uint16_t) calib[3])
+#define AC5 ((uint16_t) calib[4])
+#define AC6 ((uint16_t) calib[5])
+#define B1  calib[6]
+#define B2  calib[7]
+#define MC  calib[9]
+#define MD  calib[10]
+
+static int64_t now_us(void) {
+    return k_ticks_to_us_floor64(k_uptime_ticks());
+}
+
+/**
+ * @brief Datasheet temperature compensation, returns B5
+ */
+static int32_t bmp180_emul_b5(int32_t ut) {
+    int32_t x1 = (ut - AC6) * AC5 / 32768;
+    int32_t x2 = MC * 2048 / (x1 + MD);
+    return x1 + x2;
+}
+
+/**
+ * @brief Datasheet pressure compensation, returns pressure in Pa
+ */
+static int32_t bmp180_emul_pressure(int32_t up, int32_t b5, uint8_t oss) {
+    int32_t b6 = b5 - 4000;
+    int32_t x1 = (B2 * (b6 * b6 / 4096)) / 2048;
+    int32_t x2 = AC2 * b6 / 2048;
+    int32_t x3 = x1 + x2;
+    int32_t b3 = (((AC1 * 4 + x3) << oss) + 2) / 4;
+    uint32_t b4, b7;
+    int32_t p;
+
+    x1 = AC3 * b6 / 8192;
+    x2 = (B1 * (b6 * b6 / 4096)) / 65536;
+    x3 = ((x1 + x2) + 2) / 4;
+    b4 = AC4 * (uint32_t) (x3 + 32768) / 32768;
+    b7 = ((uint32_t) up - b3) * (50000 >> oss);
+    if (b7 < 0x80000000) {
+        p = (b7 * 2) / b4;
+    } else {
+        p = (b7 / b4) * 2;
+    }
+    x1 = (p / 256) * (p / 256);
+    x1 = (x1 * 3038) / 65536;
+    x2 = (-7357 * p) / 65536;
+    return p + (x1 + x2 + 3791) / 16;
+}
+
+/**
+ * @brief Find the raw temperature giving the simulated temperature
+ */
+static int32_t bmp180_emul_ut(int32_t temperature) {
+    int32_t lo = 0, hi = 0xFFFF;
+    int32_t target = temperature / 10;   // 0.1 degC
+
+    while (lo < hi) {
+        int32_t mid = (lo + hi) / 2;
+        if ((bmp180_emul_b5(mid) + 8) / 16 < target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * @brief Find the raw pressure giving the simulated pressure
+ */
+static int32_t bmp180_emul_up(int32_t pressure, int32_t b5, uint8_t oss) {
+    int32_t lo = 0, hi = (1 << (16 + oss)) - 1;
+
+    while (lo < hi) {
+        int32_t mid = (lo + hi) / 2;
+        if (bmp180_emul_pressure(mid, b5, oss) < pressure) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * @brief Latch the conversion result once the conversion time has elapsed
+ */
+static void bmp180_emul_update(struct bmp180_emul_data *data) {
+    if (data->conv_done_us && now_us() >= data->conv_done_us) {
+        memcpy(&data->reg[OUT_MSB], data->pending, sizeof(data->pending));
+        data->reg[CTRL_MEAS] &= ~CTRL_SCO;
+        data->conv_done_us = 0;
+    }
+}
+
+static void bmp180_emul_reset(struct bmp180_emul_data *data) {
+    memset(data->reg, 0, sizeof(data->reg));
+    for (int i = 0; i < ARRAY_SIZE(calib); i++) {
+        data->reg[CALIB + 2 * i] = (uint16_t) calib[i] >> 8;
+        data->reg[CALIB + 2 * i + 1] = (uint16_t) calib[i] & 0xFF;
+    }
+    data->reg[ID] = CHIP_ID;
+    data->reg[OUT_MSB] = 0x80;
+    data->conv_done_us = 0;
+}
+
+/**
+ * @brief Start a conversion written to CTRL_MEAS
+ */
+static void bmp180_emul_start(struct bmp180_emul_data *data, uint8_t cmd) {
+    env_sample_t env;
+    uint8_t oss = cmd >> 6;
+    int32_t ut;
+    uint32_t raw;
+
+    env_scenario_get(&env);
+    ut = bmp180_emul_ut(env.temperature);
+    switch (cmd & 0x1F) {
+    case CMD_TEMP & 0x1F:
+        raw = (uint32_t) ut << 8;
+        data->conv_done_us = now_us() + T_CONV_TEMP;
+        break;
+    case CMD_PRESS & 0x1F:
+        raw = (uint32_t) bmp180_emul_up(env.pressure, bmp180_emul_b5(ut), oss) << (8 - oss);
+        data->conv_done_us = now_us() + t_conv_press[oss];
+        break;
+    default:
+        return;
+    }
+    data->pending[0] = (raw >> 16) & 0xFF;
+    data->pending[1] = (raw >> 8) & 0xFF;
+    data->pending[2] = raw & 0xFF;
+    data->reg[CTRL_MEAS] = cmd | CTRL_SCO;
+}
+
+static void bmp180_emul_write(struct bmp180_emul_data *data, uint8_t reg, uint8_t value) {
+    switch (reg) {
+    case SOFT:
+        if (value == SOFT_RESET) {
+            bmp180_emul_reset(data);
+        }
+        break;
+    case CTRL_MEAS:
+        bmp180_emul_start(data, value);
+        break;
+    default:
+        break;   // calibration, id and output registers are read only
+    }
+}
+
+static int bmp180_emul_transfer(struct i2c_emul *emul, struct i2c_msg *msgs, int num_msgs, int addr) {
+    struct bmp180_emul_data *data = CONTAINER_OF(emul, struct bmp180_emul_data, emul_i2c);
+
+    env_bus_delay(msgs, num_msgs);
+    if (!env_scenario_sensor_present(ENV_SENSOR_BMP180)) {
+        return -EIO;
+    }
+    bmp180_emul_update(data);
+
+    for (int i = 0; i < num_msgs; i++) {
+        if (msgs[i].flags & I2C_MSG_READ) {
+            for (int j = 0; j < msgs[i].len; j++) {
+                msgs[i].buf[j] = data->reg[data->ptr++];
+            }
+        } else if (msgs[i].len > 0) {
+            data->ptr = msgs[i].buf[0];
+            for (int j = 1; j < msgs[i].len; j++) {
+                bmp180_emul_write(data, data->ptr++, msgs[i].buf[j]);
+            }
+        }
+    }
+    return 0;
+}
+
+static struct i2c_emul_api bmp180_emul_api_i2c = {
+    .transfer = bmp180_emul_transfer,
+};
+
+static int bmp180_emul_init(const struct emul *emul, const struct device *parent) {
+    const struct bmp180_emul_cfg *cfg = emul->cfg;
+    struct bmp180_emul_data *data = cfg->data;
+
+    data->emul_i2c.api = &bmp180_emul_api_i2c;
+    data->emul_i2c.addr = cfg->addr;
+    bmp180_emul_reset(data);
+
+    return i2c_emul_register(parent, emul->dev_label, &data->emul_i2c);
+}
+
+#define BMP180_EMUL(n)                                                                                                                                         \
+    static struct bmp180_emul_data bmp180_emul_data_##n;                                                                                                       \
+    static const struct bmp180_emul_cfg bmp180_emul_cfg_##n = {                                                                                                \
+        .label = DT_INST_LABEL(n),                                                                                                                             \
+        .data = &bmp180_emul_data_##n,                                                                                                                         \
+        .addr = DT_INST_REG_ADDR(n),                                                                                                                           \
+    };                                                                                                                                                         \
+    EMUL_DEFINE(bmp180_emul_init, DT_DRV_INST(n), &bmp180_emul_cfg_##n)
+
+DT_INST_FOREACH_STATUS_OKAY(BMP180_EMUL)
@@ -0,0 +1,133 @@
+/** @file
+ *  @brief Simulated environment shared by the sensor emulators
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <kernel.h>
+#include <stdint.h>
+
+#include "env_scenario.h"
+
+#define BASE_TEMPERATURE 2150     // 21.50 degC
+#define BASE_PRESSURE    101325   // Pa
+#define BASE_HUMIDITY    4500     // 45.00 %RH
+
+#define RAMP_PERIOD_MS 600000   // full up/down ramp every 10 minutes
+#define RAMP_TEMP_SPAN 1000     // +/- 10.00 degC
+#define RAMP_PRES_SPAN 2000     // +/- 2000 Pa
+#define RAMP_HUM_SPAN  3000     // +/- 30.00 %RH
+
+#define BATTERY_FULL      3200   // mV, two fresh alkaline cells
+#define BATTERY_EMPTY     2000   // mV
+#define BATTERY_DRAIN_MIN 1      // mV lost per simulated minute
+
+#define BUS_BIT_TIME_US 10   // I2C_BITRATE_STANDARD
+
+#define NOISE_TEMP 25   // +/- 0.25 degC
+#define NOISE_PRES 30   // +/- 30 Pa
+#define NOISE_HUM  80   // +/- 0.80 %RH
+
+static uint32_t noise_state = 0x2545F491;
+
+/**
+ * @brief xorshift32 pseudo random generator, deterministic between runs
+ *
+ * @param span amplitude of the noise
+ * @return int32_t value in [-span, span]
+ */
+static int32_t env_noise(int32_t span) {
+    noise_state ^= noise_state << 13;
+    noise_state ^= noise_state >> 17;
+    noise_state ^= noise_state << 5;
+    return (int32_t) (noise_state % (uint32_t) (2 * span + 1)) - span;
+}
+
+/**
+ * @brief Triangle wave in [-span, span] with RAMP_PERIOD_MS period
+ *
+ * @param now uptime in ms
+ * @param span amplitude
+ * @return int32_t ramp value
+ */
+static int32_t env_ramp(int64_t now, int32_t span) {
+    int64_t phase = now % RAMP_PERIOD_MS;
+    int64_t half = RAMP_PERIOD_MS / 2;
+
+    if (phase < half) {
+        return (int32_t) (-span + (2 * span * phase) / half);
+    }
+    return (int32_t) (span - (2 * span * (phase - half)) / half);
+}
+
+/**
+ * @brief Get the current simulated conditions
+ *
+ * @param sample pointer to returned conditions
+ */
+void env_scenario_get(env_sample_t *sample) {
+    int64_t now = k_uptime_get();
+
+    sample->temperature = BASE_TEMPERATURE;
+    sample->pressure = BASE_PRESSURE;
+    sample->humidity = BASE_HUMIDITY;
+    sample->battery = MAX(BATTERY_FULL - (int32_t) (now / 60000) * BATTERY_DRAIN_MIN, BATTERY_EMPTY);
+
+    if (IS_ENABLED(CONFIG_APP_SIM_SCENARIO_RAMP) || IS_ENABLED(CONFIG_APP_SIM_SCENARIO_DROPOUT)) {
+        sample->temperature += env_ramp(now, RAMP_TEMP_SPAN);
+        sample->pressure += env_ramp(now, RAMP_PRES_SPAN);
+        sample->humidity += env_ramp(now, RAMP_HUM_SPAN);
+    }
+    if (IS_ENABLED(CONFIG_APP_SIM_SCENARIO_NOISE)) {
+        sample->temperature += env_noise(NOISE_TEMP);
+        sample->pressure += env_noise(NOISE_PRES);
+        sample->humidity += env_noise(NOISE_HUM);
+    }
+}
+
+/**
+ * @brief Tell whether an emulated sensor answers on the bus right now
+ *
+ * Sensors drop out in turn so every driver error path gets exercised.
+ *
+ * @param sensor sensor index
+ * @return true sensor ACKs, false sensor NACKs
+ */
+bool env_scenario_sensor_present(enum env_sensor sensor) {
+#ifdef CONFIG_APP_SIM_SCENARIO_DROPOUT
+    int64_t now = k_uptime_get();
+    int64_t slot = now / CONFIG_APP_SIM_DROPOUT_PERIOD_MS;
+
+    if (slot == 0) {
+        return true;   // let the drivers probe and calibrate at boot
+    }
+    if (((slot - 1) % ENV_SENSOR_COUNT) != sensor) {
+        return true;
+    }
+    return (now % CONFIG_APP_SIM_DROPOUT_PERIOD_MS) >= CONFIG_APP_SIM_DROPOUT_LENGTH_MS;
+#else
+    return true;
+#endif
+}
+
+/**
+ * @brief Consume the time the transfer would take on a 100 kHz bus
+ *
+ * Drivers that poll a status register in a tight loop only make
+ * progress in simulation if each transfer advances the simulated clock.
+ *
+ * @param msgs transfer messages
+ * @param num_msgs number of messages
+ */
+void env_bus_delay(const struct i2c_msg *msgs, int num_msgs) {
+    uint32_t bits = 2;   // stop condition
+
+    for (int i = 0; i < num_msgs; i++) {
+        bits += 1 + 9 * (msgs[i].len + 1);   // (re)start, address and data bytes with ACK
+    }
+    k_busy_wait(bits * BUS_BIT_TIME_US);
+}
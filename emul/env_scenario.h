@@ -0,0 +1,35 @@
+/** @file
+ *  @brief Simulated environment header
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _ENV_SCENARIO_H_
+#define _ENV_SCENARIO_H_
+
+#include <stdbool.h>
+#include <drivers/i2c.h>
+#include <stdint.h>
+
+enum env_sensor { ENV_SENSOR_BMP180, ENV_SENSOR_AM2320, ENV_SENSOR_COUNT };
+
+/**
+ * @struct env_sample env_scenario.h env_scenario.h
+ * @brief Physical conditions seen by the emulated sensors at a given time.
+ * */
+typedef struct env_sample {
+    int32_t temperature;   // 0.01 degC
+    int32_t pressure;      // Pa
+    int32_t humidity;      // 0.01 %RH
+    int32_t battery;       // mV
+} env_sample_t;
+
+void env_scenario_get(env_sample_t *sample);
+bool env_scenario_sensor_present(enum env_sensor sensor);
+void env_bus_delay(const struct i2c_msg *msgs, int num_msgs);
+
+#endif
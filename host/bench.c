@@ -0,0 +1,152 @@
+/** @file
+ *  @brief BTHome decoder benchmark
+ *
+ *  Decodes a corpus synthesized by the fleet generator in a loop on one
+ *  thread per core and reports the decoded packets per second per core.
+ *
+ *  bthome_bench [-t threads] [-d seconds] [-n corpus packets] [-f]
+ *  -f decodes gateway frames instead of advertising data.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fleet.h>
+
+#define FRAME_MAX (12 + FLEET_ADV_MAX)
+
+/**
+ * @struct bench_corpus
+ * @brief Packets decoded by every thread.
+ * */
+struct bench_corpus {
+    fleet_adv_t *advs;
+    uint8_t (*frames)[FRAME_MAX];
+    uint8_t *frame_len;
+    uint32_t count;
+    bool frame_mode;
+    double seconds;
+};
+
+/**
+ * @struct bench_thread
+ * @brief Per thread result.
+ * */
+struct bench_thread {
+    pthread_t thread;
+    const struct bench_corpus *corpus;
+    uint64_t decoded;
+    uint64_t errors;
+    double seconds;
+};
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *bench_run(void *arg) {
+    struct bench_thread *self = arg;
+    const struct bench_corpus *corpus = self->corpus;
+    double start = now();
+    double elapsed;
+
+    do {
+        for (uint32_t i = 0; i < corpus->count; i++) {
+            bthome_packet_t packet;
+            int err;
+
+            if (corpus->frame_mode) {
+                bthome_frame_t frame;
+                uint8_t addr[7];
+                int8_t rssi;
+                size_t skipped;
+
+                err = bthome_frame_next(corpus->frames[i], corpus->frame_len[i], &frame, &skipped) ? bthome_frame_report(&frame, addr, &rssi, &packet) : -1;
+            } else {
+                err = bthome_decode_adv(corpus->advs[i].data, corpus->advs[i].len, &packet);
+            }
+            self->errors += err < 0;
+        }
+        self->decoded += corpus->count;
+        elapsed = now() - start;
+    } while (elapsed < corpus->seconds);
+    self->seconds = elapsed;
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    struct bench_corpus corpus = {.count = 100000, .seconds = 2};
+    struct bench_thread *workers;
+    fleet_t fleet;
+    double total = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:d:n:f")) != -1) {
+        switch (opt) {
+        case 't':
+            threads = strtol(optarg, NULL, 0);
+            break;
+        case 'd':
+            corpus.seconds = strtod(optarg, NULL);
+            break;
+        case 'n':
+            corpus.count = strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            corpus.frame_mode = true;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-d seconds] [-n corpus packets] [-f]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    corpus.advs = calloc(corpus.count, sizeof(*corpus.advs));
+    corpus.frames = calloc(corpus.count, sizeof(*corpus.frames));
+    corpus.frame_len = calloc(corpus.count, 1);
+    workers = calloc(threads, sizeof(*workers));
+    if (corpus.advs == NULL || corpus.frames == NULL || corpus.frame_len == NULL || workers == NULL || fleet_init(&fleet, 1000, 1) != 0) {
+        fprintf(stderr, "out of memory\n");
+        return 2;
+    }
+    for (uint32_t i = 0; i < corpus.count; i++) {
+        fleet_step(&fleet, i % fleet.count, &corpus.advs[i]);
+        corpus.frame_len[i] = fleet_frame(&fleet, &corpus.advs[i], -60, corpus.frames[i]);
+    }
+
+    for (long t = 0; t < threads; t++) {
+        workers[t].corpus = &corpus;
+        pthread_create(&workers[t].thread, NULL, bench_run, &workers[t]);
+    }
+    for (long t = 0; t < threads; t++) {
+        double rate;
+
+        pthread_join(workers[t].thread, NULL);
+        rate = workers[t].decoded / workers[t].seconds;
+        total += rate;
+        printf("bench: thread %ld: %.0f %s/s, %llu errors\n", t, rate, corpus.frame_mode ? "frames" : "packets",
+               (unsigned long long) workers[t].errors);
+    }
+    printf("bench: %ld threads, %.0f %s/s total, %.0f per core\n", threads, total, corpus.frame_mode ? "frames" : "packets", total / threads);
+
+    fleet_free(&fleet);
+    free(workers);
+    free(corpus.frame_len);
+    free(corpus.frames);
+    free(corpus.advs);
+    return 0;
+}
@@ -0,0 +1,182 @@
+/** @file
+ *  @brief Host BTHome v2 decoder code
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <bthome_host.h>
+#include <gateway.h>
+
+#define AD_TYPE_SVC_DATA16 0x16
+
+static const struct {
+    uint8_t id;
+    bthome_object_info_t info;
+} object_infos[] = {
+    {BTHOME_PACKET_ID, {"packet_id", "", 1}},       {BTHOME_BATTERY, {"battery", "%", 1}},
+    {BTHOME_TEMPERATURE, {"temperature", "C", 100}}, {BTHOME_HUMIDITY, {"humidity", "%", 100}},
+    {BTHOME_PRESSURE, {"pressure", "hPa", 100}},     {BTHOME_DEW_POINT, {"dew_point", "C", 100}},
+    {BTHOME_VOLTAGE, {"voltage", "V", 1000}},        {BTHOME_BUTTON, {"button", "", 1}},
+    {BTHOME_DISTANCE_M, {"distance", "m", 10}},
+};
+
+/**
+ * @brief Decode a service data payload
+ *
+ * @param data service data: UUID, device information and objects
+ * @param len size of data
+ * @param packet decoded payload
+ * @return int number of objects, negative error code from bthome_parse_begin() or bthome_parse_next()
+ */
+int bthome_decode_service(const uint8_t *data, size_t len, bthome_packet_t *packet) {
+    bthome_reader_t reader;
+    bthome_object_t object;
+    int err;
+
+    err = bthome_parse_begin(&reader, data, len);
+    if (err < 0) {
+        return err;
+    }
+    packet->device_info = err;
+    packet->packet_id = -1;
+    packet->count = 0;
+    while ((err = bthome_parse_next(&reader, &object)) == 1) {
+        if (packet->count == BTHOME_HOST_MAX_OBJECTS) {
+            return -E2BIG;
+        }
+        if (object.id == BTHOME_PACKET_ID) {
+            packet->packet_id = object.value[0];
+        }
+        packet->values[packet->count].id = object.id;
+        packet->values[packet->count].raw = bthome_object_value(&object);
+        packet->count++;
+    }
+    return err < 0 ? err : packet->count;
+}
+
+/**
+ * @brief Decode the BTHome service data of an advertising payload
+ *
+ * @param data advertising data, a sequence of length, type, value structures
+ * @param len size of data
+ * @param packet decoded payload
+ * @return int number of objects, -ENOENT without BTHome service data, -EBADMSG when malformed
+ */
+int bthome_decode_adv(const uint8_t *data, size_t len, bthome_packet_t *packet) {
+    size_t pos = 0;
+
+    while (pos + 1 < len) {
+        uint8_t field_len = data[pos];
+
+        if (field_len == 0 || pos + 1 + field_len > len) {
+            return -EBADMSG;
+        }
+        if (data[pos + 1] == AD_TYPE_SVC_DATA16 && field_len >= 3 && (data[pos + 2] | (data[pos + 3] << 8)) == BTHOME_SERVICE_UUID) {
+            return bthome_decode_service(&data[pos + 2], field_len - 1, packet);
+        }
+        pos += 1 + field_len;
+    }
+    return -ENOENT;
+}
+
+/**
+ * @brief Name and unit of an object
+ *
+ * @param id object id
+ * @return const bthome_object_info_t* description, NULL for unknown objects
+ */
+const bthome_object_info_t *bthome_object_info(uint8_t id) {
+    for (size_t i = 0; i < sizeof(object_infos) / sizeof(object_infos[0]); i++) {
+        if (object_infos[i].id == id) {
+            return &object_infos[i].info;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @brief CRC-8 CCITT (polynomial 0x07), same as Zephyr crc8_ccitt()
+ *
+ * @param crc initial value
+ * @param data input
+ * @param len size of data
+ * @return uint8_t crc
+ */
+uint8_t bthome_crc8(uint8_t crc, const uint8_t *data, size_t len) {
+    static const uint8_t nibble[16] = {0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15, 0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d};
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= data[i];
+        crc = (uint8_t) (crc << 4) ^ nibble[crc >> 4];
+        crc = (uint8_t) (crc << 4) ^ nibble[crc >> 4];
+    }
+    return crc;
+}
+
+/**
+ * @brief Find the next valid frame of a gateway stream
+ *
+ * Bytes before a valid frame (garbage, corrupted frames) are skipped.
+ *
+ * @param data stream bytes
+ * @param len size of data
+ * @param frame set to the frame found, payload points into data
+ * @param skipped set to the number of bytes skipped before the frame
+ * @return size_t bytes consumed including the frame, 0 when no complete frame is available (skipped bytes may be discarded)
+ */
+size_t bthome_frame_next(const uint8_t *data, size_t len, bthome_frame_t *frame, size_t *skipped) {
+    size_t pos = 0;
+
+    for (; pos + 4 <= len; pos++) {
+        uint8_t frame_len;
+
+        if (data[pos] != GATEWAY_SYNC) {
+            continue;
+        }
+        frame_len = data[pos + 2];
+        if (pos + 4 + frame_len > len) {
+            break;   // may be complete later
+        }
+        if (bthome_crc8(0xff, &data[pos + 1], 2 + frame_len) != data[pos + 3 + frame_len]) {
+            continue;
+        }
+        frame->type = data[pos + 1];
+        frame->len = frame_len;
+        frame->payload = &data[pos + 3];
+        *skipped = pos;
+        return pos + 4 + frame_len;
+    }
+    *skipped = pos;
+    return 0;
+}
+
+/**
+ * @brief Decode a GATEWAY_FRAME_REPORT frame
+ *
+ * @param frame frame from bthome_frame_next()
+ * @param addr set to the address type then the address, little endian
+ * @param rssi set to the report RSSI
+ * @param packet decoded payload
+ * @return int number of objects, -EINVAL when not a report, errors of bthome_decode_service()
+ */
+int bthome_frame_report(const bthome_frame_t *frame, uint8_t addr[7], int8_t *rssi, bthome_packet_t *packet) {
+    uint8_t service[2 + UINT8_MAX];
+
+    if (frame->type != GATEWAY_FRAME_REPORT || frame->len < 8 + 1) {
+        return -EINVAL;
+    }
+    memcpy(addr, frame->payload, 7);
+    *rssi = (int8_t) frame->payload[7];
+    // the UUID is implied by the frame type
+    service[0] = BTHOME_SERVICE_UUID & 0xff;
+    service[1] = BTHOME_SERVICE_UUID >> 8;
+    memcpy(&service[2], &frame->payload[8], frame->len - 8);
+    return bthome_decode_service(service, 2 + frame->len - 8, packet);
+}
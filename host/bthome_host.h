@@ -0,0 +1,81 @@
+/** @file
+ *  @brief Host BTHome v2 decoder header
+ *
+ *  Decodes what the firmware advertises (raw advertising data or service
+ *  data) and what the gateway streams over USB (include/gateway.h). Object
+ *  parsing is the firmware's own code, src/bthome.c.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _BTHOME_HOST_H_
+#define _BTHOME_HOST_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <bthome.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BTHOME_HOST_MAX_OBJECTS 16   // 26 bytes of service data hold 13 objects at most
+
+/**
+ * @struct bthome_value bthome_host.h bthome_host.h
+ * @brief One decoded object.
+ * */
+typedef struct bthome_value {
+    uint8_t id;
+    int32_t raw;   // value in the object unit, as given to bthome_add()
+} bthome_value_t;
+
+/**
+ * @struct bthome_packet bthome_host.h bthome_host.h
+ * @brief One decoded service data payload.
+ * */
+typedef struct bthome_packet {
+    uint8_t device_info;
+    int16_t packet_id;   // -1 when absent
+    uint8_t count;
+    bthome_value_t values[BTHOME_HOST_MAX_OBJECTS];
+} bthome_packet_t;
+
+/**
+ * @struct bthome_object_info bthome_host.h bthome_host.h
+ * @brief Name and unit of an object id.
+ * */
+typedef struct bthome_object_info {
+    const char *name;
+    const char *unit;
+    int32_t divisor;   // physical value = raw / divisor
+} bthome_object_info_t;
+
+/**
+ * @struct bthome_frame bthome_host.h bthome_host.h
+ * @brief One gateway frame, payload points into the input buffer.
+ * */
+typedef struct bthome_frame {
+    uint8_t type;   // GATEWAY_FRAME_*
+    uint8_t len;
+    const uint8_t *payload;
+} bthome_frame_t;
+
+int bthome_decode_service(const uint8_t *data, size_t len, bthome_packet_t *packet);
+int bthome_decode_adv(const uint8_t *data, size_t len, bthome_packet_t *packet);
+const bthome_object_info_t *bthome_object_info(uint8_t id);
+
+uint8_t bthome_crc8(uint8_t crc, const uint8_t *data, size_t len);
+size_t bthome_frame_next(const uint8_t *data, size_t len, bthome_frame_t *frame, size_t *skipped);
+int bthome_frame_report(const bthome_frame_t *frame, uint8_t addr[7], int8_t *rssi, bthome_packet_t *packet);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,26 @@
+/** @file
+ *  @brief Host stand-in for the Zephyr kernel header
+ *
+ *  Just what the firmware sources built on the host use.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _HOST_KERNEL_H_
+#define _HOST_KERNEL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+#define MIN(a, b)         (((a) < (b)) ? (a) : (b))
+#define MAX(a, b)         (((a) > (b)) ? (a) : (b))
+#define BIT(n)            (1UL << (n))
+#define BIT_MASK(n)       (BIT(n) - 1UL)
+
+#endif
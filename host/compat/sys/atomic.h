@@ -0,0 +1,32 @@
+/** @file
+ *  @brief Host stand-in for the Zephyr atomic header
+ *
+ *  The host tools drive the firmware code from a single thread.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _HOST_SYS_ATOMIC_H_
+#define _HOST_SYS_ATOMIC_H_
+
+typedef long atomic_t;
+typedef atomic_t atomic_val_t;
+
+#define ATOMIC_INIT(i) (i)
+
+static inline atomic_val_t atomic_get(const atomic_t *target) {
+    return *target;
+}
+
+static inline atomic_val_t atomic_set(atomic_t *target, atomic_val_t value) {
+    atomic_val_t old = *target;
+
+    *target = value;
+    return old;
+}
+
+#endif
@@ -0,0 +1,165 @@
+/** @file
+ *  @brief Derived metrics accuracy test
+ *
+ *  Sweeps the input ranges of src/derived.c and compares every result with
+ *  libm (double). Fails when an error exceeds the bound documented in
+ *  src/derived.c, prints the worst error of each function, then the time
+ *  per call of derived_dew_point() and of the same formula with libm.
+ *
+ *  derived_test
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <derived.h>
+
+#define ONE_Q24     ((double) (1 << DERIVED_FRAC_BITS))
+#define TIMED_CALLS 10000000
+
+/**
+ * @struct derived_check
+ * @brief Worst error of one function against its bound.
+ * */
+struct derived_check {
+    const char *name;
+    double bound;
+    double worst;
+    double at[2];
+};
+
+/**
+ * @brief Record one error
+ *
+ * @param check function being checked
+ * @param error absolute or relative error
+ * @param a first input
+ * @param b second input
+ */
+static void derived_record(struct derived_check *check, double error, double a, double b) {
+    error = fabs(error);
+    if (error > check->worst) {
+        check->worst = error;
+        check->at[0] = a;
+        check->at[1] = b;
+    }
+}
+
+/**
+ * @brief Print the worst error of a function
+ *
+ * @return true the worst error is within the bound
+ */
+static bool derived_report(const struct derived_check *check) {
+    bool ok = check->worst < check->bound;
+
+    printf("%-22s worst %.3g (bound %.3g) at %g, %g: %s\n", check->name, check->worst, check->bound, check->at[0], check->at[1],
+           ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief Print the time per call of the dew point, fixed point and libm
+ *
+ * The inputs walk the sensor range so that neither loop can be hoisted,
+ * the results are summed into a volatile so that neither is dropped.
+ */
+static void derived_time(void) {
+    volatile double sink = 0;
+    double start, fixed, libm;
+    int64_t sum = 0;
+    double sum_libm = 0;
+
+    start = now();
+    for (int32_t i = 0; i < TIMED_CALLS; i++) {
+        sum += derived_dew_point(i % 12001 - 4000, 100 + i % 9901);
+    }
+    fixed = now() - start;
+    sink = sum;
+
+    start = now();
+    for (int32_t i = 0; i < TIMED_CALLS; i++) {
+        double tc = (i % 12001 - 4000) / 100.0;
+        double gamma = log((100 + i % 9901) / 10000.0) + 17.62 * tc / (243.12 + tc);
+
+        sum_libm += 243.12 * gamma / (17.62 - gamma);
+    }
+    libm = now() - start;
+    sink = sum_libm;
+    (void) sink;
+
+    printf("derived_dew_point()    %.1f ns per call, libm %.1f ns\n", fixed * 1e9 / TIMED_CALLS, libm * 1e9 / TIMED_CALLS);
+}
+
+int main(void) {
+    struct derived_check log2_check = {.name = "derived_log2()", .bound = 6e-6};
+    struct derived_check exp2_check = {.name = "derived_exp2()", .bound = 1e-5};
+    struct derived_check dew_check = {.name = "derived_dew_point()", .bound = 0.011};
+    struct derived_check abs_check = {.name = "derived_abs_humidity()", .bound = 0.011};
+    struct derived_check alt_check = {.name = "derived_altitude()", .bound = 0.11};
+    struct derived_check sea_check = {.name = "derived_sea_pressure()", .bound = 3};
+    bool ok = true;
+
+    // Every octave, with a step that is not a power of two
+    for (uint64_t x = 1; x <= UINT32_MAX; x += 1 + x / 997) {
+        derived_record(&log2_check, derived_log2((uint32_t) x) / ONE_Q24 - log2((double) x), (double) x, 0);
+    }
+
+    for (int32_t y = -8 * (1 << DERIVED_FRAC_BITS); y < 7 * (1 << DERIVED_FRAC_BITS); y += 4099) {
+        double ref = exp2(y / ONE_Q24);
+
+        derived_record(&exp2_check, (derived_exp2(y) / ONE_Q24 - ref) / ref, y / ONE_Q24, 0);
+    }
+
+    for (int32_t t = -4000; t <= 8000; t += 7) {
+        for (int32_t rh = 0; rh <= 10000; rh += 13) {
+            double tc = t / 100.0;
+            double gamma = log(rh / 10000.0) + 17.62 * tc / (243.12 + tc);
+            double ah = 6.112 * exp(17.67 * tc / (tc + 243.5)) * (rh / 100.0) * 2.1674 / (273.15 + tc);
+
+            if (rh >= 100) {
+                derived_record(&dew_check, derived_dew_point(t, rh) / 100.0 - 243.12 * gamma / (17.62 - gamma), tc, rh / 100.0);
+            }
+            derived_record(&abs_check, derived_abs_humidity(t, rh) / 100.0 - ah, tc, rh / 100.0);
+        }
+    }
+
+    for (int32_t p = 30000; p <= 110000; p += 3) {
+        double ref = 44330.0 * (1.0 - pow(p / (double) DERIVED_SEA_LEVEL_PA, 1.0 / 5.255));
+
+        derived_record(&alt_check, derived_altitude(p, DERIVED_SEA_LEVEL_PA) / 10.0 - ref, p, DERIVED_SEA_LEVEL_PA);
+    }
+
+    for (int32_t h = -5000; h <= 30000; h += 11) {
+        for (int32_t p = 70000; p <= 108000; p += 1000) {
+            double ref = p / pow(1.0 - h / 10.0 / 44330.0, 5.255);
+
+            derived_record(&sea_check, derived_sea_pressure(p, h) - ref, p, h / 10.0);
+        }
+    }
+
+    ok &= derived_report(&log2_check);
+    ok &= derived_report(&exp2_check);
+    ok &= derived_report(&dew_check);
+    ok &= derived_report(&abs_check);
+    ok &= derived_report(&alt_check);
+    ok &= derived_report(&sea_check);
+    derived_time();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+/** @file
+ *  @brief Virtual BTHome node fleet code
+ *
+ *  Each virtual node random walks the firmware measures and encodes them
+ *  with the firmware encoder (src/bthome.c) in the order of
+ *  pipeline_encode(): packet id, button event, temperature, pressure,
+ *  humidity, battery, voltage, dew point. One node in four has no packet
+ *  id and no button, like a firmware built without CONFIG_APP_BUTTON.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fleet.h>
+#include <gateway.h>
+
+#define AD_TYPE_FLAGS      0x01
+#define AD_TYPE_SVC_DATA16 0x16
+#define AD_FLAGS           0x06   // general discoverable, no BR/EDR
+#define SERVICE_MAX        26
+
+static uint32_t fleet_rand(fleet_t *fleet) {
+    // xorshift64*
+    fleet->rng ^= fleet->rng >> 12;
+    fleet->rng ^= fleet->rng << 25;
+    fleet->rng ^= fleet->rng >> 27;
+    return (uint32_t) ((fleet->rng * 2685821657736338717ULL) >> 32);
+}
+
+static int32_t walk(fleet_t *fleet, int32_t value, int32_t step, int32_t min, int32_t max) {
+    value += (int32_t) (fleet_rand(fleet) % (2 * step + 1)) - step;
+    return value < min ? min : value > max ? max : value;
+}
+
+/**
+ * @brief Create the virtual nodes
+ *
+ * @param fleet fleet to initialize
+ * @param count number of nodes
+ * @param seed random seed, same seed same streams
+ * @return int error code
+ */
+int fleet_init(fleet_t *fleet, uint32_t count, uint64_t seed) {
+    fleet->nodes = calloc(count, sizeof(fleet_node_t));
+    if (fleet->nodes == NULL) {
+        return -ENOMEM;
+    }
+    fleet->count = count;
+    fleet->rng = seed | 1;
+    for (uint32_t i = 0; i < count; i++) {
+        fleet_node_t *node = &fleet->nodes[i];
+
+        node->addr[0] = 1;   // random static
+        for (int b = 1; b < 7; b++) {
+            node->addr[b] = fleet_rand(fleet);
+        }
+        node->addr[6] |= 0xc0;
+        node->packet_id = fleet_rand(fleet);
+        node->has_packet_id = fleet_rand(fleet) % 4 != 0;
+        node->temperature = 1500 + fleet_rand(fleet) % 1500;
+        node->pressure = 98000 + fleet_rand(fleet) % 5000;
+        node->humidity = 3000 + fleet_rand(fleet) % 4000;
+        node->voltage = 2600 + fleet_rand(fleet) % 600;
+    }
+    return 0;
+}
+
+void fleet_free(fleet_t *fleet) {
+    free(fleet->nodes);
+    fleet->nodes = NULL;
+}
+
+static void expect(bthome_packet_t *expected, uint8_t id, int32_t raw) {
+    expected->values[expected->count].id = id;
+    expected->values[expected->count].raw = raw;
+    expected->count++;
+}
+
+/**
+ * @brief Advance one node and encode its next advertisement
+ *
+ * @param fleet fleet
+ * @param index node index
+ * @param adv synthesized advertisement and expected decoded values
+ */
+void fleet_step(fleet_t *fleet, uint32_t index, fleet_adv_t *adv) {
+    fleet_node_t *node = &fleet->nodes[index];
+    bthome_buf_t buf;
+    const struct {
+        uint8_t id;
+        int32_t value;
+    } objects[] = {
+        {BTHOME_PACKET_ID, ++node->packet_id},
+        {BTHOME_BUTTON, node->button},
+        {BTHOME_TEMPERATURE, node->temperature = walk(fleet, node->temperature, 5, -4000, 8500)},
+        {BTHOME_PRESSURE, node->pressure = walk(fleet, node->pressure, 10, 30000, 110000)},
+        {BTHOME_HUMIDITY, node->humidity = walk(fleet, node->humidity, 10, 0, 10000)},
+        {BTHOME_BATTERY, (node->voltage - 2000) / 12},
+        {BTHOME_VOLTAGE, node->voltage = walk(fleet, node->voltage, 1, 2000, 3200)},
+        {BTHOME_DEW_POINT, node->temperature - (10000 - node->humidity) / 5},
+    };
+
+    node->button = (fleet_rand(fleet) % 64 == 0) ? BTHOME_BUTTON_PRESS + fleet_rand(fleet) % 2 : BTHOME_BUTTON_NONE;
+
+    adv->node = index;
+    adv->data[0] = 2;
+    adv->data[1] = AD_TYPE_FLAGS;
+    adv->data[2] = AD_FLAGS;
+    adv->service = 5;
+    adv->expected.device_info = BTHOME_DEVICE_INFO;
+    adv->expected.packet_id = node->has_packet_id ? node->packet_id : -1;
+    adv->expected.count = 0;
+    bthome_begin(&buf, &adv->data[adv->service], SERVICE_MAX);
+    for (size_t i = 0; i < sizeof(objects) / sizeof(objects[0]); i++) {
+        if ((objects[i].id == BTHOME_PACKET_ID || objects[i].id == BTHOME_BUTTON) && !node->has_packet_id) {
+            continue;
+        }
+        if (objects[i].id == BTHOME_BUTTON && objects[i].value == BTHOME_BUTTON_NONE) {
+            continue;
+        }
+        if (bthome_add(&buf, objects[i].id, objects[i].value) == 0) {
+            expect(&adv->expected, objects[i].id, objects[i].value);
+        }
+    }
+    adv->data[3] = 1 + buf.len;
+    adv->data[4] = AD_TYPE_SVC_DATA16;
+    adv->len = adv->service + buf.len;
+}
+
+/**
+ * @brief Wrap an advertisement in a gateway report frame
+ *
+ * @param fleet fleet
+ * @param adv advertisement from fleet_step()
+ * @param rssi report RSSI
+ * @param out frame, 4 + 8 + FLEET_ADV_MAX bytes at most
+ * @return size_t frame size
+ */
+size_t fleet_frame(const fleet_t *fleet, const fleet_adv_t *adv, int8_t rssi, uint8_t *out) {
+    uint8_t service_len = adv->len - adv->service - 2;   // without the UUID
+
+    out[0] = GATEWAY_SYNC;
+    out[1] = GATEWAY_FRAME_REPORT;
+    out[2] = 8 + service_len;
+    memcpy(&out[3], fleet->nodes[adv->node].addr, 7);
+    out[10] = (uint8_t) rssi;
+    memcpy(&out[11], &adv->data[adv->service + 2], service_len);
+    out[11 + service_len] = bthome_crc8(0xff, &out[1], 2 + out[2]);
+    return 12 + service_len;
+}
+
+/**
+ * @brief Compare a decoded payload with what was encoded
+ *
+ * @param adv advertisement from fleet_step()
+ * @param decoded decoded payload
+ * @return int 0 when identical, -1 otherwise
+ */
+int fleet_check(const fleet_adv_t *adv, const bthome_packet_t *decoded) {
+    const bthome_packet_t *expected = &adv->expected;
+
+    if (decoded->device_info != expected->device_info || decoded->packet_id != expected->packet_id || decoded->count != expected->count) {
+        return -1;
+    }
+    for (int i = 0; i < expected->count; i++) {
+        if (decoded->values[i].id != expected->values[i].id || decoded->values[i].raw != expected->values[i].raw) {
+            return -1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+/** @file
+ *  @brief Virtual BTHome node fleet header
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _FLEET_H_
+#define _FLEET_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <bthome_host.h>
+
+#define FLEET_ADV_MAX 31
+
+/**
+ * @struct fleet_node fleet.h fleet.h
+ * @brief State of one virtual sensor.
+ * */
+typedef struct fleet_node {
+    uint8_t addr[7];   // type, address little endian
+    uint8_t packet_id;
+    bool has_packet_id;   // nodes built without CONFIG_APP_BUTTON send no packet id
+    uint8_t button;    // pending BTHOME_BUTTON_* event
+    int32_t temperature;
+    int32_t pressure;
+    int32_t humidity;
+    int32_t voltage;
+} fleet_node_t;
+
+/**
+ * @struct fleet_adv fleet.h fleet.h
+ * @brief One synthesized advertisement and what it carries.
+ * */
+typedef struct fleet_adv {
+    uint32_t node;
+    uint8_t data[FLEET_ADV_MAX];   // flags and service data
+    uint8_t len;
+    uint8_t service;               // offset of the service data in data
+    bthome_packet_t expected;
+} fleet_adv_t;
+
+/**
+ * @struct fleet fleet.h fleet.h
+ * @brief Fleet of virtual sensors.
+ * */
+typedef struct fleet {
+    fleet_node_t *nodes;
+    uint32_t count;
+    uint64_t rng;
+} fleet_t;
+
+int fleet_init(fleet_t *fleet, uint32_t count, uint64_t seed);
+void fleet_free(fleet_t *fleet);
+void fleet_step(fleet_t *fleet, uint32_t node, fleet_adv_t *adv);
+size_t fleet_frame(const fleet_t *fleet, const fleet_adv_t *adv, int8_t rssi, uint8_t *out);
+int fleet_check(const fleet_adv_t *adv, const bthome_packet_t *decoded);
+
+#endif
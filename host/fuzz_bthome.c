@@ -0,0 +1,87 @@
+/** @file
+ *  @brief BTHome decoder fuzz target
+ *
+ *  The input is decoded as advertising data, as service data and as a
+ *  gateway frame stream. Service data that decodes is encoded again with
+ *  the firmware encoder and must give back the same bytes.
+ *
+ *  Built for libFuzzer with -DBTHOME_FUZZ=ON (clang), otherwise as a
+ *  replay tool taking corpus files as arguments.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <bthome_host.h>
+
+/**
+ * @brief Encode a decoded payload again and compare
+ */
+static void fuzz_round_trip(const uint8_t *data, size_t size, const bthome_packet_t *packet) {
+    uint8_t out[UINT8_MAX];
+    bthome_buf_t buf;
+
+    bthome_begin(&buf, out, size);
+    out[2] = packet->device_info;
+    for (int i = 0; i < packet->count; i++) {
+        if (bthome_add(&buf, packet->values[i].id, packet->values[i].raw) != 0) {
+            abort();
+        }
+    }
+    if (buf.len != size || memcmp(out, data, size) != 0) {
+        abort();
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    bthome_packet_t packet;
+    bthome_frame_t frame;
+    size_t pos = 0;
+    size_t used;
+    size_t skipped;
+
+    bthome_decode_adv(data, size, &packet);
+
+    if (bthome_decode_service(data, size, &packet) >= 0) {
+        fuzz_round_trip(data, size, &packet);
+    }
+
+    while ((used = bthome_frame_next(data + pos, size - pos, &frame, &skipped)) != 0) {
+        uint8_t addr[7];
+        int8_t rssi;
+
+        if (frame.payload + frame.len > data + size) {
+            abort();
+        }
+        bthome_frame_report(&frame, addr, &rssi, &packet);
+        pos += used;
+    }
+    return 0;
+}
+
+#ifndef BTHOME_LIBFUZZER
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        static uint8_t data[1 << 16];
+        FILE *f = fopen(argv[i], "rb");
+        size_t size;
+
+        if (f == NULL) {
+            perror(argv[i]);
+            return 2;
+        }
+        size = fread(data, 1, sizeof(data), f);
+        fclose(f);
+        LLVMFuzzerTestOneInput(data, size);
+    }
+    printf("fuzz: %d inputs replayed\n", argc - 1);
+    return 0;
+}
+#endif
@@ -0,0 +1,155 @@
+/** @file
+ *  @brief Fleet-scale BTHome load generator
+ *
+ *  Synthesizes the advertising of thousands of virtual nodes with the
+ *  firmware encoder, checks every packet round trip through the advertising
+ *  data decoder and the gateway frame decoder, and optionally writes the
+ *  stream of gateway frames a dongle would send, to feed an ingestion
+ *  pipeline offline.
+ *
+ *  bthome_loadgen [-n nodes] [-p packets per node] [-r receptions per packet]
+ *                 [-c corrupted frames per 1000] [-s seed] [-o file|-]
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <fleet.h>
+
+#define FRAME_MAX (12 + FLEET_ADV_MAX)
+
+/**
+ * @struct loadgen_stats
+ * @brief Round trip results.
+ * */
+struct loadgen_stats {
+    uint64_t packets;
+    uint64_t frames;
+    uint64_t mismatches;
+    uint64_t corrupted;
+    uint64_t corrupted_accepted;   // CRC-8 collisions, expected about 1/256 of corrupted
+};
+
+/**
+ * @brief Decode one frame as the ingestion side would
+ *
+ * @return int 0 when decoded and identical, 1 when rejected, -1 on mismatch
+ */
+static int loadgen_frame_check(const uint8_t *frame, size_t len, const fleet_adv_t *adv) {
+    bthome_frame_t decoded;
+    bthome_packet_t packet;
+    uint8_t addr[7];
+    int8_t rssi;
+    size_t skipped;
+
+    if (bthome_frame_next(frame, len, &decoded, &skipped) == 0 || skipped != 0) {
+        return 1;
+    }
+    if (bthome_frame_report(&decoded, addr, &rssi, &packet) < 0) {
+        return 1;
+    }
+    return fleet_check(adv, &packet);
+}
+
+int main(int argc, char **argv) {
+    uint32_t nodes = 5000;
+    uint32_t packets = 20;
+    uint32_t receptions = 3;
+    uint32_t corrupt = 0;
+    uint64_t seed = 1;
+    FILE *out = NULL;
+    struct loadgen_stats stats = {0};
+    struct timespec start, end;
+    fleet_t fleet;
+    double seconds;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:p:r:c:s:o:")) != -1) {
+        switch (opt) {
+        case 'n':
+            nodes = strtoul(optarg, NULL, 0);
+            break;
+        case 'p':
+            packets = strtoul(optarg, NULL, 0);
+            break;
+        case 'r':
+            receptions = strtoul(optarg, NULL, 0);
+            break;
+        case 'c':
+            corrupt = strtoul(optarg, NULL, 0);
+            break;
+        case 's':
+            seed = strtoull(optarg, NULL, 0);
+            break;
+        case 'o':
+            out = strcmp(optarg, "-") == 0 ? stdout : fopen(optarg, "wb");
+            if (out == NULL) {
+                perror(optarg);
+                return 2;
+            }
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n nodes] [-p packets] [-r receptions] [-c corrupt/1000] [-s seed] [-o file|-]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (fleet_init(&fleet, nodes, seed) != 0) {
+        fprintf(stderr, "out of memory\n");
+        return 2;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (uint32_t p = 0; p < packets; p++) {
+        for (uint32_t n = 0; n < nodes; n++) {
+            fleet_adv_t adv;
+            bthome_packet_t packet;
+            uint8_t frame[FRAME_MAX];
+            size_t len;
+
+            fleet_step(&fleet, n, &adv);
+            stats.packets++;
+            if (bthome_decode_adv(adv.data, adv.len, &packet) < 0 || fleet_check(&adv, &packet) != 0) {
+                stats.mismatches++;
+            }
+            // a scanner receives the same packet on several advertising events
+            for (uint32_t r = 0; r < receptions; r++) {
+                int check;
+
+                len = fleet_frame(&fleet, &adv, -40 - (int8_t) (rand() % 50), frame);
+                if (corrupt && (uint32_t) (rand() % 1000) < corrupt) {
+                    frame[3 + rand() % (len - 3)] ^= 1 << (rand() % 8);
+                    stats.corrupted++;
+                    if (loadgen_frame_check(frame, len, &adv) <= 0) {
+                        stats.corrupted_accepted++;
+                    }
+                } else if ((check = loadgen_frame_check(frame, len, &adv)) != 0) {
+                    stats.mismatches++;
+                }
+                if (out != NULL) {
+                    fwrite(frame, 1, len, out);
+                }
+                stats.frames++;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    fprintf(stderr, "loadgen: %u nodes, %llu packets, %llu frames, %llu mismatches, %llu corrupted (%llu accepted), %.0f packets/s\n", nodes,
+            (unsigned long long) stats.packets, (unsigned long long) stats.frames, (unsigned long long) stats.mismatches,
+            (unsigned long long) stats.corrupted, (unsigned long long) stats.corrupted_accepted, stats.packets / seconds);
+    if (out != NULL && out != stdout) {
+        fclose(out);
+    }
+    fleet_free(&fleet);
+    return stats.mismatches ? 1 : 0;
+}
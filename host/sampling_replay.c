@@ -0,0 +1,252 @@
+/** @file
+ *  @brief Adaptive sampling replay benchmark
+ *
+ *  Replays a trace through the firmware adaptive sampling (src/sampling.c)
+ *  and compares it with reading both sensors at the fixed minimum period:
+ *  reads saved, which is the sensor energy saved since the sensors sleep
+ *  between reads, against the reconstruction error of each channel when
+ *  the last read value is held until the next read.
+ *
+ *  sampling_replay [-f trace.csv] [-d days] [-s seed]
+ *  The trace has one line per second: seconds,temperature degC,humidity %RH,pressure Pa.
+ *  Without -f a synthetic indoor trace is generated: daily cycles, sensor
+ *  noise and a window opened twice a day.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <kernel.h>
+#include <pipeline.h>
+#include <sampling.h>
+
+#define PERIOD_MIN CONFIG_APP_SAMPLING_MIN_MS
+#define CHANNELS   (PIPELINE_HUMIDITY + 1)   // sensor channels, the ones sampling.c adapts
+
+/**
+ * @struct replay_point
+ * @brief True value of the sensor channels at one second.
+ * */
+struct replay_point {
+    double temperature;   // degC
+    double humidity;      // %RH
+    double pressure;      // Pa
+};
+
+/**
+ * @struct replay_error
+ * @brief Reconstruction error of one channel.
+ * */
+struct replay_error {
+    double sum2;
+    double worst;
+};
+
+static const char *const channel_name[CHANNELS] = {"bmp180 temp (0.01 degC)", "pressure (Pa)", "am2320 temp (0.01 degC)",
+                                                   "humidity (0.01 %RH)"};
+static const enum sampling_sensor channel_sensor[CHANNELS] = {SAMPLING_BMP180, SAMPLING_BMP180, SAMPLING_AM2320, SAMPLING_AM2320};
+
+static uint64_t rng_state;
+
+/**
+ * @brief Uniform random number in [0, 1)
+ */
+static double replay_rand(void) {
+    rng_state = rng_state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (rng_state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ * @brief Gaussian random number (Box-Muller)
+ *
+ * @param sigma standard deviation
+ */
+static double replay_noise(double sigma) {
+    return sigma * sqrt(-2.0 * log(1.0 - replay_rand())) * cos(2.0 * M_PI * replay_rand());
+}
+
+/**
+ * @brief Synthesize an indoor trace
+ *
+ * @param seconds trace length
+ * @return struct replay_point* one point per second, NULL when out of memory
+ */
+static struct replay_point *replay_synth(size_t seconds) {
+    struct replay_point *trace = malloc(seconds * sizeof(*trace));
+    double window = 0;   // degC below the room temperature, decays once the window is closed
+
+    if (trace == NULL) {
+        return NULL;
+    }
+    for (size_t t = 0; t < seconds; t++) {
+        double day = 2.0 * M_PI * t / 86400.0;
+        uint32_t in_day = t % 86400;
+
+        // window opened 10 minutes at 8:00 and 20:00
+        if ((in_day >= 8 * 3600 && in_day < 8 * 3600 + 600) || (in_day >= 20 * 3600 && in_day < 20 * 3600 + 600)) {
+            window += (6.0 - window) / 120.0;
+        } else {
+            window -= window / 900.0;
+        }
+        trace[t].temperature = 20.5 + 1.5 * sin(day) - window;
+        trace[t].humidity = 45.0 + 5.0 * sin(day + 1.0) + 2.0 * window;
+        trace[t].pressure = 101325.0 + 400.0 * sin(day / 3.0);
+    }
+    return trace;
+}
+
+/**
+ * @brief Load a CSV trace
+ *
+ * @param path file name
+ * @param seconds pointer to returned trace length
+ * @return struct replay_point* one point per line, NULL on error
+ */
+static struct replay_point *replay_load(const char *path, size_t *seconds) {
+    FILE *in = fopen(path, "r");
+    struct replay_point *trace = NULL;
+    size_t size = 0;
+    char line[256];
+
+    *seconds = 0;
+    if (in == NULL) {
+        perror(path);
+        return NULL;
+    }
+    while (fgets(line, sizeof(line), in) != NULL) {
+        struct replay_point point;
+        double when;
+
+        if (sscanf(line, "%lf,%lf,%lf,%lf", &when, &point.temperature, &point.humidity, &point.pressure) != 4) {
+            continue;   // header or comment
+        }
+        if (*seconds == size) {
+            struct replay_point *grown;
+
+            size = size ? 2 * size : 86400;
+            grown = realloc(trace, size * sizeof(*trace));
+            if (grown == NULL) {
+                free(trace);
+                fclose(in);
+                return NULL;
+            }
+            trace = grown;
+        }
+        trace[(*seconds)++] = point;
+    }
+    fclose(in);
+    return trace;
+}
+
+/**
+ * @brief What the drivers return for a point, in channel units
+ *
+ * The BMP180 driver returns whole degrees, the AM2320 has 0.1 resolution.
+ *
+ * @param point true values
+ * @param value returned measures, indexed by enum pipeline_channel
+ */
+static void replay_measure(const struct replay_point *point, int32_t *value) {
+    value[PIPELINE_TEMP] = 100 * (int32_t) lround(point->temperature + replay_noise(0.3));
+    value[PIPELINE_PRESSURE] = (int32_t) lround(point->pressure + replay_noise(3.0));
+    value[PIPELINE_TEMP2] = 10 * (int32_t) lround(10.0 * (point->temperature + replay_noise(0.05)));
+    value[PIPELINE_HUMIDITY] = 10 * (int32_t) lround(10.0 * (point->humidity + replay_noise(0.2)));
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    size_t seconds = 7 * 86400;
+    struct replay_point *trace;
+    int64_t next_read[SAMPLING_SENSOR_COUNT] = {0};
+    int64_t next_fixed = 0;
+    int32_t held[CHANNELS] = {0}, held_fixed[CHANNELS] = {0};
+    struct replay_error adaptive[CHANNELS] = {0}, fixed[CHANNELS] = {0};
+    uint32_t reads[SAMPLING_SENSOR_COUNT] = {0}, reads_fixed = 0;
+    int opt;
+
+    rng_state = 1;
+    while ((opt = getopt(argc, argv, "f:d:s:")) != -1) {
+        switch (opt) {
+        case 'f':
+            path = optarg;
+            break;
+        case 'd':
+            seconds = strtoul(optarg, NULL, 0) * 86400;
+            break;
+        case 's':
+            rng_state = strtoull(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-f trace.csv] [-d days] [-s seed]\n", argv[0]);
+            return 2;
+        }
+    }
+    trace = path ? replay_load(path, &seconds) : replay_synth(seconds);
+    if (trace == NULL || seconds == 0) {
+        fprintf(stderr, "no trace\n");
+        return 2;
+    }
+
+    for (size_t t = 0; t < seconds; t++) {
+        int64_t now = (int64_t) t * 1000;
+        int32_t value[CHANNELS];
+        uint32_t wake = 0;
+
+        replay_measure(&trace[t], value);
+        // Baseline: both sensors at the minimum period
+        if (now >= next_fixed) {
+            memcpy(held_fixed, value, sizeof(held_fixed));
+            reads_fixed++;
+            next_fixed += PERIOD_MIN;
+        }
+        // Adaptive: each sensor at its own period, all read early on a step
+        for (int s = 0; s < SAMPLING_SENSOR_COUNT; s++) {
+            if (now < next_read[s]) {
+                continue;
+            }
+            for (int ch = 0; ch < CHANNELS; ch++) {
+                if (channel_sensor[ch] == s) {
+                    held[ch] = value[ch];
+                    wake |= sampling_update(ch, value[ch], now);
+                }
+            }
+            reads[s]++;
+            next_read[s] = now + MAX(PERIOD_MIN, sampling_next(s));
+        }
+        for (int s = 0; s < SAMPLING_SENSOR_COUNT; s++) {
+            if (wake & BIT(s)) {
+                next_read[s] = now + 1000;
+            }
+        }
+        for (int ch = 0; ch < CHANNELS; ch++) {
+            double e = held[ch] - value[ch];
+            double e_fixed = held_fixed[ch] - value[ch];
+
+            adaptive[ch].sum2 += e * e;
+            adaptive[ch].worst = fmax(adaptive[ch].worst, fabs(e));
+            fixed[ch].sum2 += e_fixed * e_fixed;
+            fixed[ch].worst = fmax(fixed[ch].worst, fabs(e_fixed));
+        }
+    }
+
+    printf("%zu s replayed, period %u..%u ms\n", seconds, PERIOD_MIN, CONFIG_APP_SAMPLING_MAX_MS);
+    printf("reads: bmp180 %u, am2320 %u, fixed period %u each\n", reads[SAMPLING_BMP180], reads[SAMPLING_AM2320], reads_fixed);
+    printf("energy saved: bmp180 %.1f %%, am2320 %.1f %%\n", 100.0 * (1.0 - (double) reads[SAMPLING_BMP180] / reads_fixed),
+           100.0 * (1.0 - (double) reads[SAMPLING_AM2320] / reads_fixed));
+    printf("%-24s %12s %12s %12s %12s\n", "reconstruction error", "rms", "max", "fixed rms", "fixed max");
+    for (int ch = 0; ch < CHANNELS; ch++) {
+        printf("%-24s %12.1f %12.0f %12.1f %12.0f\n", channel_name[ch], sqrt(adaptive[ch].sum2 / seconds), adaptive[ch].worst,
+               sqrt(fixed[ch].sum2 / seconds), fixed[ch].worst);
+    }
+    free(trace);
+    return 0;
+}
@@ -0,0 +1,44 @@
+/** @file
+ *  @brief Advertising payload header
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _ADV_H_
+#define _ADV_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ADV_SERVICE_DATA_MAX 26   // 31 bytes AD - flags AD (3) - service data AD header (2)
+#define ADV_INTERVAL_MIN_MS  100   // legacy scannable / non-connectable minimum
+#define ADV_INTERVAL_MAX_MS  10240
+
+/**
+ * @struct adv_latency adv.h adv.h
+ * @brief Event to fast advertising latency, in us.
+ * */
+typedef struct adv_latency {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint32_t avg;
+    uint32_t late;   // above CONFIG_APP_BUTTON_LATENCY_TARGET_MS
+} adv_latency_t;
+
+int adv_init(const uint8_t *service_data, size_t len);
+int adv_start(void);
+uint8_t *adv_payload_next(void);
+void adv_payload_publish(size_t len);
+uint32_t adv_published_count(void);
+void adv_stress_run(void);
+int adv_set_interval(uint32_t ms);
+uint32_t adv_interval_ms(void);
+void adv_burst(uint32_t since);
+void adv_latency_get(adv_latency_t *latency);
+
+#endif
@@ -19,10 +19,10 @@
 
 #define AM2320_REG_HUM_H 0x00   ///< humidity register address
 
-#define NAN (-1000)
+#define AM2320_INVALID INT32_MIN   ///< returned instead of a measure when the read fails
 
 int am2320_begin();
-int32_t am2320_readTemperature();   // returns Temperature * 100
-int32_t am2320_readHumidity();      // returns Temperature * 100
+int32_t am2320_readTemperature();   // returns Temperature * 100, AM2320_INVALID on error
+int32_t am2320_readHumidity();      // returns Humidity * 100, AM2320_INVALID on error
 
 #endif
\ No newline at end of file
@@ -0,0 +1,67 @@
+/** @file
+ *  @brief Runtime configuration header
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _APP_CONFIG_H_
+#define _APP_CONFIG_H_
+
+#include <stdint.h>
+
+#define APP_CONFIG_VERSION 1
+
+/**
+ * @brief Advertised measures, bits of app_config.channels
+ */
+enum app_config_channel {
+    APP_CONFIG_TEMPERATURE,    ///< BMP180 (or fused) temperature
+    APP_CONFIG_PRESSURE,       ///< BMP180 pressure
+    APP_CONFIG_TEMPERATURE2,   ///< AM2320 temperature, without fusion
+    APP_CONFIG_HUMIDITY,       ///< AM2320 humidity
+    APP_CONFIG_BATTERY,        ///< state of charge and voltage
+    APP_CONFIG_DEW_POINT,      ///< derived dew point
+    APP_CONFIG_SEA_PRESSURE,   ///< derived sea level pressure
+    APP_CONFIG_ALTITUDE,       ///< derived altitude
+    APP_CONFIG_CHANNEL_COUNT
+};
+
+#define APP_CONFIG_CHANNELS_ALL     ((1U << APP_CONFIG_CHANNEL_COUNT) - 1)
+#define APP_CONFIG_CHANNELS_DEFAULT CONFIG_APP_CHANNELS   // checked against the payload size at build time
+
+/**
+ * @struct app_config app_config.h app_config.h
+ * @brief Tunable acquisition parameters, also the settings and GATT value.
+ * */
+typedef struct app_config {
+    uint8_t version;           // APP_CONFIG_VERSION
+    uint8_t oversampling;      // BMP180 oss, 0 (ultra low power) to 3 (ultra high resolution)
+    uint16_t channels;         // BIT(enum app_config_channel) set when advertised
+    uint32_t period_ms;        // sensor read period, lower bound with adaptive sampling
+    uint32_t adv_interval_ms;  // slow advertising interval
+} __attribute__((packed)) app_config_t;
+
+/**
+ * @struct app_config_energy app_config.h app_config.h
+ * @brief Energy estimate of one acquisition period, at the nominal supply.
+ * */
+typedef struct app_config_energy {
+    uint32_t sensor_nj;    // BMP180 and AM2320 reads, I2C and CPU
+    uint32_t adv_nj;       // advertising events during the period
+    uint32_t sleep_nj;     // System ON idle for the period
+    uint32_t total_nj;
+    uint32_t average_na;   // average current
+} __attribute__((packed)) app_config_energy_t;
+
+int app_config_init(void);
+const app_config_t *app_config_get(void);
+int app_config_set(const char *name, uint32_t value);
+int app_config_write(const app_config_t *config);
+int app_config_save(void);
+void app_config_energy(app_config_energy_t *energy);
+
+#endif
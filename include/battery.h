@@ -0,0 +1,21 @@
+/** @file
+ *  @brief Battery monitor header
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _BATTERY_H_
+#define _BATTERY_H_
+
+#include <stdint.h>
+
+int battery_init(void);
+int battery_read_mv(void);
+uint8_t battery_percent(int mv);
+void battery_start(void);
+
+#endif
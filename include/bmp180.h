@@ -13,6 +13,7 @@
 
 #include <stdint.h>
 #define BMP180_R_ADDRESS (0x77)
+#define BMP180_CALIB_LEN (22)
 
 enum _bmp180_oversampling_settings { ultra_low_power, standart, high_resolution, ultra_high_resolution };
 
@@ -51,7 +52,25 @@ typedef struct bmp180_t {
     int16_t MD;
 } bmp180_t;
 
+/**
+ * @struct bmp180_conversion_t bmp180.h bmp180.h
+ * @brief Conversion time from the command to the result, in us.
+ * */
+typedef struct bmp180_conversion_t {
+    uint32_t count;
+    uint32_t timeouts;
+    uint32_t polls;      // status reads
+    uint32_t avg_us;
+    uint32_t max_us;
+    uint32_t fixed_us;   // average of the fixed sleeps the same conversions needed
+} bmp180_conversion_t;
+
 int bmp180_begin();
+int bmp180_beginCached(uint8_t expected_id, const uint8_t *CalibrationData);
+uint8_t bmp180_getId();
+void bmp180_getCalibrationData(uint8_t *CalibrationData);
+int bmp180_setOversampling(enum _bmp180_oversampling_settings setting);
+void bmp180_conversion_get(bmp180_conversion_t *stats);
 int32_t bmp180_readPressure();      // returns Pressure * 100
 int32_t bmp180_readTemperature();   // returns Temperature * 100
 
@@ -0,0 +1,36 @@
+/** @file
+ *  @brief Boot cache header
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _BOOT_CACHE_H_
+#define _BOOT_CACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <bmp180.h>
+#include <i2c.h>
+
+#define BOOT_CACHE_VERSION 2
+
+/**
+ * @struct boot_cache boot_cache.h boot_cache.h
+ * @brief BMP180 identity and calibration saved after a cold boot.
+ * */
+typedef struct boot_cache {
+    uint8_t version;
+    uint8_t bmp_id;
+    uint8_t bmp180_calib[BMP180_CALIB_LEN];
+    uint32_t crc;   // crc32 of all previous fields
+} boot_cache_t;
+
+bool boot_sensors_begin(void);
+int boot_cache_clear(void);
+
+#endif
@@ -0,0 +1,80 @@
+/** @file
+ *  @brief BTHome v2 encoder and decoder header
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _BTHOME_H_
+#define _BTHOME_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BTHOME_SERVICE_UUID 0xfcd2 /* BTHome service UUID */
+#define BTHOME_DEVICE_INFO  0x40   /* v2, no encryption, regular interval */
+
+// Device information bits
+#define BTHOME_INFO_ENCRYPTED 0x01
+#define BTHOME_INFO_TRIGGER   0x04
+#define BTHOME_INFO_VERSION(info) ((info) >> 5)
+
+// Object ids
+#define BTHOME_PACKET_ID   0x00
+#define BTHOME_BATTERY     0x01   // uint8, %
+#define BTHOME_TEMPERATURE 0x02   // sint16, 0.01 degC
+#define BTHOME_HUMIDITY    0x03   // uint16, 0.01 %
+#define BTHOME_PRESSURE    0x04   // uint24, 0.01 hPa
+#define BTHOME_DEW_POINT   0x08   // sint16, 0.01 degC
+#define BTHOME_VOLTAGE     0x0C   // uint16, 0.001 V
+#define BTHOME_BUTTON      0x3A   // uint8, event
+#define BTHOME_DISTANCE_M  0x41   // uint16, 0.1 m
+
+// Button events
+#define BTHOME_BUTTON_NONE         0x00
+#define BTHOME_BUTTON_PRESS        0x01
+#define BTHOME_BUTTON_DOUBLE_PRESS 0x02
+#define BTHOME_BUTTON_LONG_PRESS   0x04
+
+/**
+ * @struct bthome_buf bthome.h bthome.h
+ * @brief Service data being built.
+ * */
+typedef struct bthome_buf {
+    uint8_t *data;
+    uint8_t len;
+    uint8_t size;
+} bthome_buf_t;
+
+/**
+ * @struct bthome_reader bthome.h bthome.h
+ * @brief Service data being parsed, the objects are not copied.
+ * */
+typedef struct bthome_reader {
+    const uint8_t *data;
+    uint8_t len;
+    uint8_t pos;
+} bthome_reader_t;
+
+/**
+ * @struct bthome_object bthome.h bthome.h
+ * @brief One object, value points into the service data.
+ * */
+typedef struct bthome_object {
+    uint8_t id;
+    uint8_t size;
+    const uint8_t *value;   // little endian
+} bthome_object_t;
+
+int bthome_object_size(uint8_t id);
+void bthome_begin(bthome_buf_t *buf, uint8_t *data, size_t size);
+int bthome_add(bthome_buf_t *buf, uint8_t id, int32_t value);
+
+int bthome_parse_begin(bthome_reader_t *reader, const uint8_t *data, size_t len);
+int bthome_parse_next(bthome_reader_t *reader, bthome_object_t *object);
+int32_t bthome_object_value(const bthome_object_t *object);
+
+#endif
@@ -18,6 +18,7 @@ extern "C" {
 #endif
 
 int button_init(gpio_callback_handler_t handler);
+int button_get(void);
 
 #ifdef __cplusplus
 }
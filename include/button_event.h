@@ -0,0 +1,31 @@
+/** @file
+ *  @brief Button event header
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _BUTTON_EVENT_H_
+#define _BUTTON_EVENT_H_
+
+#include <stdint.h>
+
+/**
+ * @struct button_stats button_event.h button_event.h
+ * @brief Button classification counters.
+ * */
+typedef struct button_stats {
+    uint32_t edges;     // interrupts
+    uint32_t bounces;   // edges rejected by the debounce
+    uint32_t press;
+    uint32_t double_press;
+    uint32_t long_press;
+} button_stats_t;
+
+int button_event_init(void);
+void button_event_get(button_stats_t *stats);
+
+#endif
@@ -0,0 +1,27 @@
+/** @file
+ *  @brief Derived metrics header
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _DERIVED_H_
+#define _DERIVED_H_
+
+#include <stdint.h>
+
+#define DERIVED_FRAC_BITS    24       // fixed point format of derived_log2() / derived_exp2()
+#define DERIVED_SEA_LEVEL_PA 101325   // standard atmosphere, reference of derived_altitude()
+
+int32_t derived_log2(uint32_t x);
+uint32_t derived_exp2(int32_t y);
+
+int32_t derived_dew_point(int32_t temperature, int32_t humidity);           // returns Dew point * 100
+int32_t derived_abs_humidity(int32_t temperature, int32_t humidity);        // returns g/m3 * 100
+int32_t derived_altitude(int32_t pressure, int32_t sea_pressure);           // returns m * 10
+int32_t derived_sea_pressure(int32_t pressure, int32_t altitude);           // returns Pa
+
+#endif
@@ -0,0 +1,28 @@
+/** @file
+ *  @brief Footprint report header
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _FOOTPRINT_H_
+#define _FOOTPRINT_H_
+
+#include <stdint.h>
+
+// nRF52840 product specification figures, DCDC on, 0 dBm
+#define FOOTPRINT_SLEEP_NA 3000   // nA, System ON, RTC running, RAM retained
+#define FOOTPRINT_CPU_UA   3300   // uA, CPU running from flash
+#ifdef CONFIG_APP_ADV_SCAN_RESPONSE
+#define FOOTPRINT_ADV_CHARGE_NC 10000   // nC per event, three channels with the scan request windows
+#else
+#define FOOTPRINT_ADV_CHARGE_NC 7000    // nC per event, three channels, transmit only
+#endif
+
+void footprint_start(void);
+uint32_t footprint_current_ua(void);
+
+#endif
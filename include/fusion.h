@@ -0,0 +1,37 @@
+/** @file
+ *  @brief Temperature fusion header
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _FUSION_H_
+#define _FUSION_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+enum fusion_source { FUSION_BMP180, FUSION_AM2320, FUSION_SOURCE_COUNT };
+
+/**
+ * @struct fusion_stats fusion.h fusion.h
+ * @brief State of the fused temperature estimate.
+ * */
+typedef struct fusion_stats {
+    int32_t temperature;                  // 0.01 degC
+    uint32_t variance;                    // (0.01 degC)^2
+    int32_t bias[FUSION_SOURCE_COUNT];    // 0.01 degC, removed from each source
+    uint32_t accepted;
+    uint32_t rejected;                    // outliers
+    uint32_t steps;                       // restarts after every source was rejected
+} fusion_stats_t;
+
+void fusion_reset(void);
+int32_t fusion_update(enum fusion_source source, int32_t temperature, int64_t now);
+bool fusion_stable(void);
+void fusion_get(fusion_stats_t *stats);
+
+#endif
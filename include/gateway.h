@@ -0,0 +1,47 @@
+/** @file
+ *  @brief BTHome gateway header
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _GATEWAY_H_
+#define _GATEWAY_H_
+
+#include <stdint.h>
+
+/*
+ * USB CDC-ACM frames:
+ *   sync (0xB7), type, length, payload[length], crc8 (CCITT over type, length and payload)
+ *
+ * GATEWAY_FRAME_REPORT payload:
+ *   address type, address[6] (little endian), rssi (int8), service data after the UUID
+ *   (BTHome device information then objects)
+ *
+ * GATEWAY_FRAME_STATS payload: gateway_stats_t, little endian, once per second
+ */
+#define GATEWAY_SYNC         0xB7
+#define GATEWAY_FRAME_REPORT 0x01
+#define GATEWAY_FRAME_STATS  0x02
+
+/**
+ * @struct gateway_stats gateway.h gateway.h
+ * @brief Gateway counters, rates per second over the last second.
+ * */
+typedef struct gateway_stats {
+    uint32_t adv_rate;         // advertising reports received
+    uint32_t bthome_rate;      // BTHome reports forwarded
+    uint32_t duplicates;       // same node, same packet id or payload
+    uint32_t dropped;          // frame buffer full
+    uint32_t invalid;          // malformed BTHome payload, encrypted ones are forwarded
+    uint32_t evicted;          // nodes replaced in the table
+    uint16_t nodes;            // nodes in the table
+    uint16_t max_fill;         // frame buffer high-water mark, bytes
+} __attribute__((packed)) gateway_stats_t;
+
+int gateway_start(void);
+
+#endif
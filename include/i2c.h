@@ -11,14 +11,37 @@
 #ifndef ST_BLE_I2C_H_
 #define ST_BLE_I2C_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-void i2c_scan(void);
+#define I2C_MAP_SIZE 16   // one bit per 7 bit address
+
+#define I2C_SCAN_KNOWN_ONLY 0x01   // only probe the addresses of the drivers
+
+/**
+ * @struct i2c_scan_result i2c.h i2c.h
+ * @brief Devices answering on one bus.
+ * */
+typedef struct i2c_scan_result {
+    const char *bus;
+    uint8_t map[I2C_MAP_SIZE];
+    uint8_t count;
+    uint32_t duration_us;
+} i2c_scan_result_t;
+
+static inline bool i2c_map_test(const uint8_t *map, uint8_t addr) {
+    return map[addr / 8] & (1 << (addr % 8));
+}
+
+int i2c_scan(const char *bus, uint8_t flags, i2c_scan_result_t *result);
+int i2c_scan_buses(const char *const *bus, int nb_bus, uint8_t flags, i2c_scan_result_t *result);
 
 #ifdef __cplusplus
 }
 #endif
 
-#endif
\ No newline at end of file
+#endif
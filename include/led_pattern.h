@@ -0,0 +1,39 @@
+/** @file
+ *  @brief LED status pattern header
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _LED_PATTERN_H_
+#define _LED_PATTERN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Higher value wins when several patterns are active
+enum led_pattern {
+    LED_PATTERN_ACQUIRING,     ///< one short dim flash per sensor read
+    LED_PATTERN_LOW_BATTERY,   ///< double pulse every 5 s
+    LED_PATTERN_ERROR,         ///< 2 Hz blink while the last AM2320 read failed
+    LED_PATTERN_COUNT
+};
+
+/**
+ * @struct led_pattern_stats led_pattern.h led_pattern.h
+ * @brief LED engine cost since boot.
+ * */
+typedef struct led_pattern_stats {
+    uint32_t wakeups;   // CPU interventions of the engine
+    uint32_t on_ms;     // LED on-time, weighted by the duty cycle
+    uint32_t uptime_ms;
+} led_pattern_stats_t;
+
+int led_pattern_init(void);
+void led_pattern_set(enum led_pattern pattern, bool active);
+void led_pattern_get(led_pattern_stats_t *stats);
+
+#endif
@@ -0,0 +1,38 @@
+/** @file
+ *  @brief Bluetooth Mesh sensor server header
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _MESH_SENSOR_H_
+#define _MESH_SENSOR_H_
+
+#include <stdint.h>
+
+// Mesh device properties
+#define MESH_PROP_PRESENT_AMB_TEMP   0x004F   // Temperature 8, 0.5 degC, int8
+#define MESH_PROP_PRESENT_AMB_HUMID  0x0076   // Humidity, 0.01 %, uint16
+#define MESH_PROP_AIR_PRESSURE       0x0082   // Pressure, 0.1 Pa, uint32
+
+/**
+ * @struct mesh_sensor_stats mesh_sensor.h mesh_sensor.h
+ * @brief Sensor status messages sent.
+ * */
+typedef struct mesh_sensor_stats {
+    uint32_t periodic;    // publications at the (fast) cadence
+    uint32_t triggered;   // publications on a status trigger delta
+    uint32_t replies;     // answers to get messages
+    uint32_t received;    // sink: statuses received
+    uint8_t fast;         // 1 while the fast cadence is in use
+} mesh_sensor_stats_t;
+
+int mesh_sensor_start(void);
+int mesh_sink_start(void);
+void mesh_sensor_update(const int32_t *value);
+void mesh_sensor_get(mesh_sensor_stats_t *stats);
+
+#endif
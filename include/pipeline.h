@@ -0,0 +1,50 @@
+/** @file
+ *  @brief Acquisition pipeline header
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include <stdint.h>
+
+#define PIPELINE_UNSET INT32_MIN   ///< channel not measured yet or failed read, never advertised
+
+enum pipeline_channel {
+    PIPELINE_TEMP,       ///< BMP180 temperature, 0.01 degC
+    PIPELINE_PRESSURE,   ///< BMP180 pressure, Pa
+    PIPELINE_TEMP2,      ///< AM2320 temperature, 0.01 degC
+    PIPELINE_HUMIDITY,   ///< AM2320 humidity, 0.01 %RH
+    PIPELINE_VOLTAGE,    ///< battery voltage, mV
+    PIPELINE_BATTERY,    ///< battery state of charge, %
+    PIPELINE_BUTTON,     ///< BTHOME_BUTTON_* event, timestamp is when the event was known
+    // Computed by the encoder from the channels above
+    PIPELINE_TEMP_FUSED,     ///< 0.01 degC, fusion of PIPELINE_TEMP and PIPELINE_TEMP2
+    PIPELINE_DEW_POINT,      ///< 0.01 degC
+    PIPELINE_ABS_HUMIDITY,   ///< 0.01 g/m3
+    PIPELINE_ALTITUDE,       ///< 0.1 m, standard atmosphere
+    PIPELINE_SEA_PRESSURE,   ///< Pa, reduced to sea level
+    PIPELINE_CHANNEL_COUNT
+};
+
+/**
+ * @struct pipeline_sample pipeline.h pipeline.h
+ * @brief One measure travelling from a sensor thread to the encoder.
+ * */
+typedef struct pipeline_sample {
+    uint32_t timestamp;   // k_cycle_get_32() when the read started
+    uint8_t channel;      // enum pipeline_channel
+    int32_t value;
+} pipeline_sample_t;
+
+int pipeline_init(void);
+void pipeline_start(void);
+void pipeline_wakeup(void);
+void pipeline_push(uint8_t channel, int32_t value, uint32_t timestamp);
+
+#endif
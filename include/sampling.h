@@ -0,0 +1,32 @@
+/** @file
+ *  @brief Adaptive sampling header
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _SAMPLING_H_
+#define _SAMPLING_H_
+
+#include <stdint.h>
+
+enum sampling_sensor { SAMPLING_BMP180, SAMPLING_AM2320, SAMPLING_SENSOR_COUNT };
+
+/**
+ * @struct sampling_stats sampling.h sampling.h
+ * @brief Sampling activity of one sensor.
+ * */
+typedef struct sampling_stats {
+    uint32_t period;    // current period, ms
+    uint32_t reads;     // reads done
+    uint32_t skipped;   // reads avoided compared to sampling at the minimum period
+} sampling_stats_t;
+
+uint32_t sampling_update(uint8_t channel, int32_t value, int64_t now);
+uint32_t sampling_next(enum sampling_sensor sensor);
+void sampling_get(enum sampling_sensor sensor, sampling_stats_t *stats);
+
+#endif
@@ -0,0 +1,71 @@
+/** @file
+ *  @brief Acquisition loop tracing header
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <kernel.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum trace_stage {
+    TRACE_STAGE_CYCLE,    ///< sensor read to advertising publication
+    TRACE_STAGE_BMP180,   ///< BMP180 pressure and temperature read
+    TRACE_STAGE_AM2320,   ///< AM2320 temperature and humidity read
+    TRACE_STAGE_WAIT,     ///< k_msleep inside the sensor drivers
+    TRACE_STAGE_LOG,      ///< printk of the measures
+    TRACE_STAGE_ENCODE,   ///< BTHome service data encoding
+    TRACE_STAGE_ADV,      ///< bt_le_adv_update_data()
+    TRACE_STAGE_SLEEP,    ///< sleep between two reads of a sensor
+    TRACE_STAGE_COUNT
+};
+
+/**
+ * @struct trace_stats trace.h trace.h
+ * @brief Summary of one stage histogram, durations in us.
+ * */
+typedef struct trace_stats {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint32_t p50;
+    uint32_t p99;
+} trace_stats_t;
+
+#define TRACE_DUMP_VERSION 1
+#define TRACE_DUMP_SIZE    (2 + TRACE_STAGE_COUNT * sizeof(trace_stats_t))
+
+#ifdef CONFIG_APP_TRACE
+
+uint32_t trace_begin(enum trace_stage stage);
+void trace_end(enum trace_stage stage, uint32_t start);
+void trace_get(enum trace_stage stage, trace_stats_t *stats);
+const char *trace_stage_name(enum trace_stage stage);
+size_t trace_dump(uint8_t *buf, size_t len);
+void trace_reset(void);
+
+#define TRACE_BEGIN(stage) uint32_t _trace_##stage = trace_begin(stage)
+#define TRACE_END(stage)   trace_end(stage, _trace_##stage)
+
+static inline void trace_msleep(int32_t ms) {
+    TRACE_BEGIN(TRACE_STAGE_WAIT);
+    k_msleep(ms);
+    TRACE_END(TRACE_STAGE_WAIT);
+}
+
+#else
+
+#define TRACE_BEGIN(stage)
+#define TRACE_END(stage)
+#define trace_msleep(ms) k_msleep(ms)
+
+#endif
+
+#endif
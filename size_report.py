@@ -0,0 +1,74 @@
+# Flash and RAM footprint report with regression thresholds.
+#
+# Runs after the link of every env, prints the flash and RAM used by the
+# firmware and fails the build when an env exceeds its budget in
+# size_budget.json. Stack high-water marks and the current estimate are
+# reported at run time by CONFIG_APP_FOOTPRINT (src/footprint.c).
+#
+# Each budget is a reference build plus the "margin" of size_budget.json:
+#   SIZE_BUDGET_UPDATE=1 pio run -e <env>
+# records the footprint of that build as the env reference and sets its
+# ceilings from it. A ceiling without a reference is provisional and is
+# reported as such.
+
+import json
+import math
+import os
+import subprocess
+Import("env")
+
+BUDGET_FILE = os.path.join(env.subst("$PROJECT_DIR"), "size_budget.json")
+ALIGN = 256   # ceilings rounded up to this many bytes
+
+
+def footprint(elf):
+    out = subprocess.check_output([env.subst("$SIZETOOL"), "-B", "-d", elf]).decode()
+    text, data, bss = (int(v) for v in out.splitlines()[1].split()[:3])
+    return text + data, data + bss
+
+
+def ceiling(used, margin):
+    return int(math.ceil(used * (1 + margin) / ALIGN)) * ALIGN
+
+
+def size_update(budgets, name, used):
+    budget = budgets.setdefault(name, {})
+    budget["reference"] = dict(used)
+    for what in used:
+        budget[what] = ceiling(used[what], budgets["margin"])
+    with open(BUDGET_FILE, "w") as f:
+        json.dump(budgets, f, indent=4)
+        f.write("\n")
+    print("footprint %s: reference recorded, margin %g %%" % (name, 100 * budgets["margin"]))
+
+
+def size_report(source, target, env):
+    name = env.subst("$PIOENV")
+    flash, ram = footprint(str(target[0]))
+    used = {"flash": flash, "ram": ram}
+    with open(BUDGET_FILE) as f:
+        budgets = json.load(f)
+    if os.environ.get("SIZE_BUDGET_UPDATE"):
+        size_update(budgets, name, used)
+    budget = budgets.get(name, {})
+    reference = budget.get("reference", {})
+
+    regression = False
+    for what in ("flash", "ram"):
+        limit = budget.get(what)
+        flag = ""
+        if limit is None:
+            limit = "-"
+        elif used[what] > limit:
+            flag = " REGRESSION"
+            regression = True
+        if what in reference:
+            flag += " (reference %u)" % reference[what]
+        elif limit != "-":
+            flag += " (provisional, no reference build)"
+        print("footprint %s: %-5s %7u bytes, budget %s%s" % (name, what, used[what], limit, flag))
+    if regression:
+        env.Exit(1)
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", size_report)
@@ -0,0 +1,377 @@
+/** @file
+ *  @brief Advertising payload code
+ *
+ *  The service data is triple buffered: the producer fills a private back
+ *  buffer, publication swaps it with a shared middle slot using one atomic
+ *  operation, and the advertising work item swaps the middle slot with its
+ *  front buffer before calling bt_le_adv_update_data(). The producer never
+ *  waits for the host and the host never sees a buffer being written.
+ *
+ *  An event can request a burst: advertising restarts with the fast
+ *  interval so the new payload goes on air right away instead of at the
+ *  next slow interval, then returns to the slow interval.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <bluetooth/bluetooth.h>
+#include <kernel.h>
+#include <string.h>
+#include <sys/atomic.h>
+#include <sys/printk.h>
+
+#include <adv.h>
+#include <trace.h>
+
+#define NB_BUF     3
+#define IDX_MASK   0x03
+#define DIRTY      0x04
+#define ADV_STACK  1024
+#define ADV_PRIO   K_PRIO_COOP(7)
+#ifdef CONFIG_APP_CONFIG_GATT
+#define ADV_OPTIONS (BT_LE_ADV_OPT_CONNECTABLE | BT_LE_ADV_OPT_USE_IDENTITY)
+#else
+#define ADV_OPTIONS BT_LE_ADV_OPT_USE_IDENTITY
+#endif
+#define ADV_FAST BT_LE_ADV_PARAM(ADV_OPTIONS, BT_GAP_ADV_FAST_INT_MIN_1, BT_GAP_ADV_FAST_INT_MAX_1, NULL)
+#define ADV_UNITS(ms) ((ms) * 8 / 5)   // 0.625 ms units
+
+struct adv_buf {
+    uint8_t service_data[ADV_SERVICE_DATA_MAX];
+    struct bt_data ad[2];
+};
+
+static struct adv_buf buf[NB_BUF];
+static const uint8_t flags[] = {BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR};
+
+#ifdef CONFIG_APP_ADV_SCAN_RESPONSE
+// The name goes in the scan response so the service data gets the whole advertising packet
+static const struct bt_data sd[] = {
+    BT_DATA(BT_DATA_NAME_COMPLETE, CONFIG_BT_DEVICE_NAME, sizeof(CONFIG_BT_DEVICE_NAME) - 1),
+};
+#define ADV_SD     sd
+#define ADV_SD_LEN ARRAY_SIZE(sd)
+#else
+// Non-scannable: the radio never listens for scan requests after a packet
+#define ADV_SD     NULL
+#define ADV_SD_LEN 0
+#endif
+
+static atomic_t middle;     // middle buffer index | DIRTY when not yet sent
+static uint8_t back = 1;    // owned by the producer
+static uint8_t front = 0;   // owned by the advertising work item
+static uint32_t published;
+
+#ifdef CONFIG_APP_ADV_STRESS
+#define STRESS_HDR 3   // UUID and BTHome device information are left untouched
+static uint32_t torn;
+#endif
+
+static K_THREAD_STACK_DEFINE(adv_stack, ADV_STACK);
+static struct k_work_q adv_workq;
+static struct k_work adv_work;
+
+// Slow interval and advertising state, owned by the advertising work queue
+static struct bt_le_adv_param adv_param = BT_LE_ADV_PARAM_INIT(ADV_OPTIONS, BT_GAP_ADV_SLOW_INT_MIN, BT_GAP_ADV_SLOW_INT_MAX, NULL);
+static atomic_t interval_ms = ATOMIC_INIT(BT_GAP_ADV_SLOW_INT_MIN * 5 / 8);
+static struct k_work interval_work;
+static struct k_work start_work;
+static bool started;
+static bool bursting;
+
+#ifdef CONFIG_APP_BUTTON
+static struct k_work burst_work;
+static struct k_work_delayable burst_end_work;
+static atomic_t burst_since;   // k_cycle_get_32() of the event
+static adv_latency_t latency = {.min = UINT32_MAX};
+static uint64_t latency_total;
+#endif
+
+/**
+ * @brief Send the latest published payload to the host
+ *
+ * @param work unused
+ */
+static void adv_update(struct k_work *work) {
+    int err;
+
+    if (!(atomic_get(&middle) & DIRTY)) {
+        return;   // already sent, publications were coalesced
+    }
+    front = atomic_set(&middle, front) & IDX_MASK;
+#ifdef CONFIG_APP_ADV_STRESS
+    for (size_t i = STRESS_HDR + 1; i < buf[front].ad[1].data_len; i++) {
+        if (buf[front].service_data[i] != buf[front].service_data[STRESS_HDR]) {
+            torn++;
+            break;
+        }
+    }
+#endif
+
+    TRACE_BEGIN(TRACE_STAGE_ADV);
+    err = bt_le_adv_update_data(buf[front].ad, ARRAY_SIZE(buf[front].ad), ADV_SD, ADV_SD_LEN);
+    TRACE_END(TRACE_STAGE_ADV);
+    if (err) {
+        printk("Failed to update advertising data (err %d)\n", err);
+        return;
+    }
+    if (published++ == 0) {
+        printk("first advertisement after %u ms\n", (uint32_t) k_uptime_get());
+    }
+}
+
+/**
+ * @brief Restart advertising with other parameters
+ *
+ * @param param advertising parameters
+ * @return int error code
+ */
+static int adv_restart(const struct bt_le_adv_param *param) {
+    int err = bt_le_adv_stop();
+
+    if (err) {
+        return err;
+    }
+    return bt_le_adv_start(param, buf[front].ad, ARRAY_SIZE(buf[front].ad), ADV_SD, ADV_SD_LEN);
+}
+
+/**
+ * @brief Apply the slow interval requested by adv_set_interval()
+ *
+ * @param work unused
+ */
+static void adv_interval_update(struct k_work *work) {
+    uint32_t units = ADV_UNITS((uint32_t) atomic_get(&interval_ms));
+    int err;
+
+    adv_param.interval_min = units;
+    adv_param.interval_max = MIN(units + units / 8, ADV_UNITS(ADV_INTERVAL_MAX_MS));
+    if (!started || bursting) {
+        return;   // used by the next start or at the end of the burst
+    }
+    err = adv_restart(&adv_param);
+    if (err) {
+        printk("Failed to change the advertising interval (err %d)\n", err);
+    }
+}
+
+/**
+ * @brief Change the advertising interval without stopping the payload updates
+ *
+ * @param ms interval in ms, ADV_INTERVAL_MIN_MS to ADV_INTERVAL_MAX_MS
+ * @return int error code
+ */
+int adv_set_interval(uint32_t ms) {
+    if (ms < ADV_INTERVAL_MIN_MS || ms > ADV_INTERVAL_MAX_MS) {
+        return -EINVAL;
+    }
+    atomic_set(&interval_ms, ms);
+    k_work_submit_to_queue(&adv_workq, &interval_work);
+    return 0;
+}
+
+/**
+ * @brief Current advertising interval
+ *
+ * @return uint32_t interval in ms, lower bound
+ */
+uint32_t adv_interval_ms(void) {
+    return atomic_get(&interval_ms);
+}
+
+#ifdef CONFIG_APP_BUTTON
+
+/**
+ * @brief Switch to the fast interval and account the event latency
+ *
+ * Queued after adv_work, so the front buffer already holds the event. The
+ * first fast packet follows bt_le_adv_start() within the advertising delay
+ * (10 ms at most), which is not measurable from the host.
+ *
+ * @param work unused
+ */
+static void adv_burst_start(struct k_work *work) {
+    uint32_t us;
+    int err = 0;
+
+    if (!bursting) {
+        err = adv_restart(ADV_FAST);
+        bursting = (err == 0);
+    }
+    if (err) {
+        printk("Failed to start the advertising burst (err %d)\n", err);
+        return;
+    }
+    k_work_reschedule_for_queue(&adv_workq, &burst_end_work, K_MSEC(CONFIG_APP_BUTTON_BURST_MS));
+
+    us = k_cyc_to_us_floor32(k_cycle_get_32() - (uint32_t) atomic_get(&burst_since));
+    latency.count++;
+    latency.min = MIN(latency.min, us);
+    latency.max = MAX(latency.max, us);
+    latency_total += us;
+    if (us > CONFIG_APP_BUTTON_LATENCY_TARGET_MS * USEC_PER_MSEC) {
+        latency.late++;
+    }
+}
+
+static void adv_burst_end(struct k_work *work) {
+    int err = adv_restart(&adv_param);
+
+    if (err) {
+        printk("Failed to end the advertising burst (err %d)\n", err);
+    }
+    bursting = false;
+}
+
+/**
+ * @brief Advertise the last published payload at the fast interval for a while
+ *
+ * Call right after adv_payload_publish(). Never blocks.
+ *
+ * @param since k_cycle_get_32() when the event was known
+ */
+void adv_burst(uint32_t since) {
+    atomic_set(&burst_since, since);
+    k_work_submit_to_queue(&adv_workq, &burst_work);
+}
+
+/**
+ * @brief Get the event to fast advertising latency
+ *
+ * @param out latency statistics
+ */
+void adv_latency_get(adv_latency_t *out) {
+    *out = latency;
+    out->avg = latency.count ? (uint32_t) (latency_total / latency.count) : 0;
+    if (latency.count == 0) {
+        out->min = 0;
+    }
+}
+#endif
+
+/**
+ * @brief Start advertising the front buffer
+ *
+ * @param work unused
+ */
+static void adv_start_work(struct k_work *work) {
+    int err = bt_le_adv_start(&adv_param, buf[front].ad, ARRAY_SIZE(buf[front].ad), ADV_SD, ADV_SD_LEN);
+
+    started = (err == 0);
+    if (err) {
+        printk("Failed to start advertising (err %d)\n", err);
+    }
+}
+
+/**
+ * @brief Init the payload buffers with the first service data
+ *
+ * @param service_data service data advertised until the first publication
+ * @param len service data size
+ * @return int error code
+ */
+int adv_init(const uint8_t *service_data, size_t len) {
+    if (len > ADV_SERVICE_DATA_MAX) {
+        return -EINVAL;
+    }
+    for (int i = 0; i < NB_BUF; i++) {
+        memcpy(buf[i].service_data, service_data, len);
+        buf[i].ad[0] = (struct bt_data) BT_DATA(BT_DATA_FLAGS, flags, sizeof(flags));
+        buf[i].ad[1] = (struct bt_data) BT_DATA(BT_DATA_SVC_DATA16, buf[i].service_data, len);
+    }
+    atomic_set(&middle, 2);
+
+    k_work_queue_start(&adv_workq, adv_stack, K_THREAD_STACK_SIZEOF(adv_stack), ADV_PRIO, NULL);
+    k_thread_name_set(&adv_workq.thread, "adv");
+    k_work_init(&adv_work, adv_update);
+    k_work_init(&interval_work, adv_interval_update);
+    k_work_init(&start_work, adv_start_work);
+#ifdef CONFIG_APP_BUTTON
+    k_work_init(&burst_work, adv_burst_start);
+    k_work_init_delayable(&burst_end_work, adv_burst_end);
+#endif
+    return 0;
+}
+
+/**
+ * @brief Start advertising
+ *
+ * The start runs on the advertising work queue, the only owner of the
+ * front buffer and of the advertising state, so it can be called from the
+ * Bluetooth ready callback. A start failure is printed by the work item.
+ *
+ * @return int error code, the start could not be queued
+ */
+int adv_start(void) {
+    int err = k_work_submit_to_queue(&adv_workq, &start_work);
+
+    return err < 0 ? err : 0;
+}
+
+/**
+ * @brief Get the buffer to fill for the next publication
+ *
+ * @return uint8_t* service data buffer of ADV_SERVICE_DATA_MAX bytes, owned by the caller until adv_payload_publish()
+ */
+uint8_t *adv_payload_next(void) {
+    return buf[back].service_data;
+}
+
+/**
+ * @brief Publish the buffer returned by adv_payload_next()
+ *
+ * Never blocks: the host update runs on the advertising work queue.
+ *
+ * @param len service data size
+ */
+void adv_payload_publish(size_t len) {
+    buf[back].ad[1].data_len = MIN(len, ADV_SERVICE_DATA_MAX);
+    back = atomic_set(&middle, back | DIRTY) & IDX_MASK;
+    k_work_submit_to_queue(&adv_workq, &adv_work);
+}
+
+/**
+ * @brief Number of payloads handed to the host
+ *
+ * @return uint32_t count
+ */
+uint32_t adv_published_count(void) {
+    return published;
+}
+
+#ifdef CONFIG_APP_ADV_STRESS
+/**
+ * @brief Publish uniform patterns as fast as possible and count torn packets
+ *
+ * Every payload has all its bytes set to the same value, so any mix of two
+ * publications seen by the advertising work item is detected. Never returns.
+ */
+void adv_stress_run(void) {
+    uint8_t pattern = 0;
+    uint32_t loops = 0;
+    int64_t report = k_uptime_get() + 1000;
+
+    for (;;) {
+        uint8_t *data = adv_payload_next();
+
+        pattern++;
+        for (size_t i = STRESS_HDR; i < ADV_SERVICE_DATA_MAX; i++) {
+            data[i] = pattern;
+            if ((i & 3) == 0) {
+                k_yield();   // widen the window for a torn read
+            }
+        }
+        adv_payload_publish(ADV_SERVICE_DATA_MAX);
+        loops++;
+        if (k_uptime_get() >= report) {
+            printk("adv stress: %u published/s, %u sent, %u torn\n", loops, published, torn);
+            loops = 0;
+            report += 1000;
+        }
+    }
+}
+#endif
@@ -13,9 +13,11 @@
 #include <drivers/gpio.h>
 #include <drivers/i2c.h>
 #include <drivers/spi.h>
+#include <errno.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <sys/printk.h>
+#include <trace.h>
 
 static const struct device *i2c_am2320;
 /**
@@ -44,9 +46,11 @@ uint16_t am2320_crc16(uint8_t *buffer, uint8_t nbytes) {
 /**
  * @brief Read uint16 register from am2330
  *
+ * The first write only wakes the sensor up and is never acknowledged.
+ *
  * @param RegNum Index of register
- * @param Value pointer to returned Value
- * @return int error code
+ * @param Value pointer to returned Value, 0xFFFF on error
+ * @return int error code, -EIO on a malformed reply or a CRC error
  */
 int am2320_readRegister16(uint8_t RegNum, uint16_t *Value) {
     // reads a series of bytes, starting from a specific register
@@ -56,8 +60,9 @@ int am2320_readRegister16(uint8_t RegNum, uint16_t *Value) {
     uint16_t the_crc;
     uint16_t calc_crc;
 
-    nack = i2c_write(i2c_am2320, in_buf, 1, AM2320_R_ADDRESS);
-    k_msleep(10);   // wait 10 ms
+    *Value = 0xFFFF;
+    i2c_write(i2c_am2320, in_buf, 1, AM2320_R_ADDRESS);   // wake-up
+    trace_msleep(10);                                     // wait 10 ms
 
     in_buf[0] = AM2320_CMD_READREG;
     in_buf[1] = RegNum;
@@ -65,28 +70,30 @@ int am2320_readRegister16(uint8_t RegNum, uint16_t *Value) {
     in_buf[3] = 0;
     in_buf[4] = 0;
     in_buf[5] = 0;
-    // nack=i2c_reg_read_byte(i2c_am2320,AM2320_R_ADDRESS,RegNum,Value);
     nack = i2c_write(i2c_am2320, in_buf, 3, AM2320_R_ADDRESS);
-    k_msleep(2);
+    if (nack) {
+        return nack;
+    }
+    trace_msleep(2);
     nack = i2c_read(i2c_am2320, out_buf, 6, AM2320_R_ADDRESS);
+    if (nack) {
+        return nack;
+    }
     if (out_buf[0] != 0x03) {
-        *Value = 0xFFFF;
-        return nack;   // must be 0x03 modbus reply
+        return -EIO;   // must be 0x03 modbus reply
     }
     if (out_buf[1] != 2) {
-        *Value = 0xFFFF;
-        return nack;   // must be 2 bytes reply
+        return -EIO;   // must be 2 bytes reply
     }
     the_crc = (out_buf[5] << 8) | out_buf[4];
     calc_crc = am2320_crc16(out_buf, 4);   // preamble + data
     printk("CRC: %02x \r\n", calc_crc);
 
     if (the_crc != calc_crc) {
-        *Value = 0xFFFF;
-        return nack;
+        return -EIO;
     }
     *Value = (out_buf[2] << 8) | out_buf[3];
-    return nack;
+    return 0;
 }
 /**
  * @brief Write uint16 register ( not coded)
@@ -119,15 +126,14 @@ int am2320_begin() {
 /**
  * @brief Read temperature from am2320
  *
- * @return int32_t temperature
+ * @return int32_t temperature, AM2320_INVALID when the read failed
  */
 int32_t am2320_readTemperature()   // returns Temperature * 100
 {
     uint16_t t;
     float ft;
-    am2320_readRegister16(AM2320_REG_TEMP_H, &t);
-    if (t == 0xFFFF)
-        return NAN;
+    if (am2320_readRegister16(AM2320_REG_TEMP_H, &t) != 0)
+        return AM2320_INVALID;
     // check sign bit - the temperature MSB is signed , bit 0-15 are magnitude
     if (t & 0x8000) {
         ft = -(int16_t) (t & 0x7fff);
@@ -140,15 +146,13 @@ int32_t am2320_readTemperature()   // returns Temperature * 100
 /**
  * @brief return humidity from am2320
  *
- * @return int32_t humidity value
+ * @return int32_t humidity value, AM2320_INVALID when the read failed
  */
-int32_t am2320_readHumidity()   // returns Temperature * 100
+int32_t am2320_readHumidity()   // returns Humidity * 100
 {
     uint16_t h;
-    am2320_readRegister16(AM2320_REG_HUM_H, &h);
-
-    if (h == 0xFFFF)
-        return NAN;
+    if (am2320_readRegister16(AM2320_REG_HUM_H, &h) != 0)
+        return AM2320_INVALID;
 
     return (h * 10);
 }
\ No newline at end of file
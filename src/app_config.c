@@ -0,0 +1,431 @@
+/** @file
+ *  @brief Runtime configuration code
+ *
+ *  The acquisition parameters live in one small record. A change from the
+ *  shell or the GATT characteristic is checked against the parameter
+ *  ranges, applied right away and saved after CONFIG_APP_CONFIG_SAVE_DELAY_S
+ *  without change, so a tuning session costs one flash write. Nothing is
+ *  written when the record matches what the flash already holds.
+ *
+ *  The energy estimate is a model: BMP180 average current per sample from
+ *  the datasheet, AM2320 wake-up and measure, CPU active time per cycle,
+ *  advertising events over the period and the System ON sleep current, at
+ *  a 3 V supply.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <kernel.h>
+#include <settings/settings.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/printk.h>
+
+#ifdef CONFIG_APP_CONFIG_SHELL
+#include <shell/shell.h>
+#endif
+#ifdef CONFIG_APP_CONFIG_GATT
+#include <bluetooth/conn.h>
+#include <bluetooth/gatt.h>
+#include <bluetooth/uuid.h>
+#include <random/rand32.h>
+#endif
+
+#include <adv.h>
+#include <app_config.h>
+#include <footprint.h>
+#include <pipeline.h>
+
+#ifdef CONFIG_APP_CONFIG
+
+#define APP_CONFIG_KEY "app/cfg/v"
+#define PASSKEY_KEY    "app/cfg/pk"
+#define PASSKEY_MAX    999999
+#define PERIOD_MIN_MS  1000
+#define PERIOD_MAX_MS  3600000
+
+#define SUPPLY_MV        3000
+#define AM2320_CHARGE_NC 2000   // 950 uA for about 2 ms of wake-up and measure
+#define CPU_CYCLE_US     1000   // wake-ups, I2C transfers and encoding per period
+
+// BMP180 average current at one sample per second, per oss
+static const uint16_t bmp180_charge_nc[] = {3000, 5000, 7000, 12000};
+
+struct app_config_param {
+    const char *name;
+    const char *unit;
+    uint8_t offset;
+    uint8_t size;
+    uint32_t min;
+    uint32_t max;
+};
+
+static const struct app_config_param params[] = {
+    {"oversampling", "oss", offsetof(app_config_t, oversampling), sizeof(uint8_t), 0, ARRAY_SIZE(bmp180_charge_nc) - 1},
+    {"channels", "mask", offsetof(app_config_t, channels), sizeof(uint16_t), 0, APP_CONFIG_CHANNELS_ALL},
+    {"period", "ms", offsetof(app_config_t, period_ms), sizeof(uint32_t), PERIOD_MIN_MS, PERIOD_MAX_MS},
+    {"interval", "ms", offsetof(app_config_t, adv_interval_ms), sizeof(uint32_t), ADV_INTERVAL_MIN_MS, ADV_INTERVAL_MAX_MS},
+};
+
+static const app_config_t defaults = {
+    .version = APP_CONFIG_VERSION,
+    .oversampling = CONFIG_APP_BMP180_OVERSAMPLING,
+    .channels = APP_CONFIG_CHANNELS_DEFAULT,
+    .period_ms = 1600,
+    .adv_interval_ms = 1000,
+};
+
+static app_config_t config __aligned(4);   // live record, fields read without the lock
+static app_config_t stored;                // what the flash holds, defaults when nothing was saved
+static K_MUTEX_DEFINE(config_lock);
+static struct k_work_delayable save_work;
+#ifdef CONFIG_APP_CONFIG_GATT
+static uint32_t passkey = UINT32_MAX;      // random pairing passkey, UINT32_MAX until loaded or drawn
+#endif
+
+static int app_config_set_cb(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg) {
+    const char *next;
+
+    if (settings_name_steq(name, "v", &next) && !next) {
+        if (len != sizeof(stored) || read_cb(cb_arg, &stored, sizeof(stored)) != sizeof(stored)) {
+            return -EINVAL;
+        }
+        return 0;
+    }
+#ifdef CONFIG_APP_CONFIG_GATT
+    if (settings_name_steq(name, "pk", &next) && !next) {
+        if (len != sizeof(passkey) || read_cb(cb_arg, &passkey, sizeof(passkey)) != sizeof(passkey)) {
+            return -EINVAL;
+        }
+        return 0;
+    }
+#endif
+    return -ENOENT;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(app_cfg, "app/cfg", NULL, app_config_set_cb, NULL, NULL);
+
+static uint32_t app_config_field(const app_config_t *c, const struct app_config_param *p) {
+    uint32_t value = 0;
+
+    memcpy(&value, (const uint8_t *) c + p->offset, p->size);   // little endian
+    return value;
+}
+
+static void app_config_put(app_config_t *c, const struct app_config_param *p, uint32_t value) {
+    memcpy((uint8_t *) c + p->offset, &value, p->size);
+}
+
+/**
+ * @brief Check every parameter of a record
+ *
+ * @param c record
+ * @return int 0 when valid, -EINVAL otherwise
+ */
+static int app_config_check(const app_config_t *c) {
+    if (c->version != APP_CONFIG_VERSION) {
+        return -EINVAL;
+    }
+    for (int i = 0; i < ARRAY_SIZE(params); i++) {
+        uint32_t value = app_config_field(c, &params[i]);
+
+        if (value < params[i].min || value > params[i].max) {
+            return -EINVAL;
+        }
+    }
+    return 0;
+}
+
+static void app_config_save_work(struct k_work *work) {
+    app_config_save();
+}
+
+/**
+ * @brief Apply and persist a complete record
+ *
+ * The sensor threads are woken up so a new period, oversampling or
+ * channel mask is visible in the next payload.
+ *
+ * @param new_config record, checked before use
+ * @return int error code
+ */
+int app_config_write(const app_config_t *new_config) {
+    app_config_t old;
+
+    if (app_config_check(new_config) != 0) {
+        return -EINVAL;
+    }
+    k_mutex_lock(&config_lock, K_FOREVER);
+    old = config;
+    config = *new_config;
+    k_mutex_unlock(&config_lock);
+
+    if (old.adv_interval_ms != new_config->adv_interval_ms) {
+        adv_set_interval(new_config->adv_interval_ms);
+    }
+    if (old.oversampling != new_config->oversampling || old.channels != new_config->channels || old.period_ms != new_config->period_ms) {
+        pipeline_wakeup();
+    }
+    k_work_reschedule(&save_work, K_SECONDS(CONFIG_APP_CONFIG_SAVE_DELAY_S));
+    return 0;
+}
+
+/**
+ * @brief Change one parameter
+ *
+ * @param name parameter name: oversampling, channels, period or interval
+ * @param value new value
+ * @return int -ENOENT unknown name, -EINVAL out of range
+ */
+int app_config_set(const char *name, uint32_t value) {
+    app_config_t c;
+
+    for (int i = 0; i < ARRAY_SIZE(params); i++) {
+        if (strcmp(name, params[i].name) == 0) {
+            // checked before app_config_put() truncates it to the field size
+            if (value < params[i].min || value > params[i].max) {
+                return -EINVAL;
+            }
+            k_mutex_lock(&config_lock, K_FOREVER);
+            c = config;
+            k_mutex_unlock(&config_lock);
+            app_config_put(&c, &params[i], value);
+            return app_config_write(&c);
+        }
+    }
+    return -ENOENT;
+}
+
+/**
+ * @brief Live configuration
+ *
+ * @return const app_config_t* record, fields may be read from any thread
+ */
+const app_config_t *app_config_get(void) {
+    return &config;
+}
+
+/**
+ * @brief Write the configuration now if it differs from the flash
+ *
+ * @return int error code
+ */
+int app_config_save(void) {
+    app_config_t c;
+    int err = 0;
+
+    k_work_cancel_delayable(&save_work);
+    k_mutex_lock(&config_lock, K_FOREVER);
+    c = config;
+    k_mutex_unlock(&config_lock);
+    if (memcmp(&c, &stored, sizeof(c)) == 0) {
+        return 0;
+    }
+    err = settings_save_one(APP_CONFIG_KEY, &c, sizeof(c));
+    if (err) {
+        printk("config save failed (err %d)\n", err);
+        return err;
+    }
+    stored = c;
+    return 0;
+}
+
+/**
+ * @brief Estimate the energy of one acquisition period
+ *
+ * Every period is counted with one read of each sensor at the oversampling
+ * ceiling; with the fusion the AM2320 is read less often and the estimate
+ * is an upper bound.
+ *
+ * @param energy pointer to returned estimate
+ */
+void app_config_energy(app_config_energy_t *energy) {
+    uint32_t period = config.period_ms;
+    uint64_t sensor_nc = bmp180_charge_nc[config.oversampling] + AM2320_CHARGE_NC + FOOTPRINT_CPU_UA * CPU_CYCLE_US / 1000;
+    uint64_t adv_nc = (uint64_t) FOOTPRINT_ADV_CHARGE_NC * period / config.adv_interval_ms;
+    uint64_t sleep_nc = (uint64_t) FOOTPRINT_SLEEP_NA * period / MSEC_PER_SEC;
+
+    energy->sensor_nj = (uint32_t) (sensor_nc * SUPPLY_MV / 1000);
+    energy->adv_nj = (uint32_t) (adv_nc * SUPPLY_MV / 1000);
+    energy->sleep_nj = (uint32_t) (sleep_nc * SUPPLY_MV / 1000);
+    energy->total_nj = energy->sensor_nj + energy->adv_nj + energy->sleep_nj;
+    energy->average_na = (uint32_t) ((sensor_nc + adv_nc + sleep_nc) * 1000 / period);
+}
+
+#ifdef CONFIG_APP_CONFIG_GATT
+#define APP_CONFIG_UUID(n) BT_UUID_128_ENCODE(0x8c3a0000 + (n), 0x2e6b, 0x4f0a, 0x9d51, 0x6b7e1f2c4a90)
+
+static struct bt_uuid_128 service_uuid = BT_UUID_INIT_128(APP_CONFIG_UUID(0));
+static struct bt_uuid_128 config_uuid = BT_UUID_INIT_128(APP_CONFIG_UUID(1));
+static struct bt_uuid_128 energy_uuid = BT_UUID_INIT_128(APP_CONFIG_UUID(2));
+
+static ssize_t gatt_config_read(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset) {
+    app_config_t c;
+
+    k_mutex_lock(&config_lock, K_FOREVER);
+    c = config;
+    k_mutex_unlock(&config_lock);
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, &c, sizeof(c));
+}
+
+static ssize_t gatt_config_write(struct bt_conn *conn, const struct bt_gatt_attr *attr, const void *buf, uint16_t len, uint16_t offset, uint8_t flags) {
+    app_config_t c;
+
+    if (offset != 0 || len != sizeof(c)) {
+        return BT_GATT_ERR(BT_ATT_ERR_INVALID_ATTRIBUTE_LEN);
+    }
+    memcpy(&c, buf, sizeof(c));
+    if (app_config_write(&c) != 0) {
+        return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+    }
+    return len;
+}
+
+static ssize_t gatt_energy_read(struct bt_conn *conn, const struct bt_gatt_attr *attr, void *buf, uint16_t len, uint16_t offset) {
+    app_config_energy_t energy;
+
+    app_config_energy(&energy);
+    return bt_gatt_attr_read(conn, attr, buf, len, offset, &energy, sizeof(energy));
+}
+
+// Authenticated permissions: the peer must pair with the passkey first
+BT_GATT_SERVICE_DEFINE(app_config_svc, BT_GATT_PRIMARY_SERVICE(&service_uuid),
+                       BT_GATT_CHARACTERISTIC(&config_uuid.uuid, BT_GATT_CHRC_READ | BT_GATT_CHRC_WRITE, BT_GATT_PERM_READ_AUTHEN | BT_GATT_PERM_WRITE_AUTHEN,
+                                              gatt_config_read, gatt_config_write, NULL),
+                       BT_GATT_CHARACTERISTIC(&energy_uuid.uuid, BT_GATT_CHRC_READ, BT_GATT_PERM_READ_AUTHEN, gatt_energy_read, NULL, NULL));
+
+static void auth_passkey_display(struct bt_conn *conn, unsigned int passkey) {
+    printk("config: pairing, passkey %06u\n", passkey);
+}
+
+static void auth_cancel(struct bt_conn *conn) {
+    printk("config: pairing cancelled\n");
+}
+
+static struct bt_conn_auth_cb auth_cb = {
+    .passkey_display = auth_passkey_display,
+    .cancel = auth_cancel,
+};
+
+/**
+ * @brief Pairing passkey of this device
+ *
+ * Unless CONFIG_APP_CONFIG_PASSKEY sets one, the passkey is drawn on the
+ * first boot and kept in settings, so no two devices share it.
+ *
+ * @return unsigned int passkey, 0 to 999999
+ */
+static unsigned int app_config_passkey(void) {
+#if CONFIG_APP_CONFIG_PASSKEY >= 0
+    return CONFIG_APP_CONFIG_PASSKEY;
+#else
+    int err;
+
+    if (passkey <= PASSKEY_MAX) {
+        return passkey;
+    }
+    if (sys_csrand_get(&passkey, sizeof(passkey)) != 0) {
+        passkey = sys_rand32_get();
+    }
+    passkey %= PASSKEY_MAX + 1;
+    err = settings_save_one(PASSKEY_KEY, &passkey, sizeof(passkey));
+    if (err) {
+        printk("config: passkey save failed (err %d)\n", err);
+    }
+    return passkey;
+#endif
+}
+#endif
+
+/**
+ * @brief Load the saved configuration and apply it
+ *
+ * Called after pipeline_init() so the advertising work queue exists.
+ *
+ * @return int error code
+ */
+int app_config_init(void) {
+    int err;
+
+    k_work_init_delayable(&save_work, app_config_save_work);
+    stored = defaults;
+    err = settings_subsys_init();
+    if (err) {
+        printk("settings init failed (err %d)\n", err);
+    } else {
+        settings_load_subtree("app/cfg");
+    }
+    if (app_config_check(&stored) != 0) {
+        printk("config: saved record ignored\n");
+        stored = defaults;
+    }
+    config = stored;
+    adv_set_interval(config.adv_interval_ms);
+
+#ifdef CONFIG_APP_CONFIG_GATT
+    bt_passkey_set(app_config_passkey());
+    bt_conn_auth_cb_register(&auth_cb);
+    printk("config: pairing passkey %06u\n", app_config_passkey());
+#endif
+    return err;
+}
+
+#ifdef CONFIG_APP_CONFIG_SHELL
+static int cmd_config_show(const struct shell *shell, size_t argc, char **argv) {
+    for (int i = 0; i < ARRAY_SIZE(params); i++) {
+        shell_print(shell, "%-12s %8u %-4s [%u..%u]%s", params[i].name, app_config_field(&config, &params[i]), params[i].unit, params[i].min,
+                    params[i].max, app_config_field(&config, &params[i]) != app_config_field(&stored, &params[i]) ? " unsaved" : "");
+    }
+    return 0;
+}
+
+static int cmd_config_set(const struct shell *shell, size_t argc, char **argv) {
+    char *end;
+    uint32_t value = strtoul(argv[2], &end, 0);
+    int err;
+
+    if (*end != '\0') {
+        shell_error(shell, "invalid value %s", argv[2]);
+        return -EINVAL;
+    }
+    err = app_config_set(argv[1], value);
+    if (err == -ENOENT) {
+        shell_error(shell, "unknown parameter %s", argv[1]);
+    } else if (err) {
+        shell_error(shell, "%s out of range", argv[1]);
+    }
+    return err;
+}
+
+static int cmd_config_save(const struct shell *shell, size_t argc, char **argv) {
+    return app_config_save();
+}
+
+static int cmd_config_reset(const struct shell *shell, size_t argc, char **argv) {
+    return app_config_write(&defaults);
+}
+
+static int cmd_config_energy(const struct shell *shell, size_t argc, char **argv) {
+    app_config_energy_t energy;
+
+    app_config_energy(&energy);
+    shell_print(shell, "per %u ms period: sensors %u nJ, advertising %u nJ, sleep %u nJ, total %u nJ", config.period_ms, energy.sensor_nj,
+                energy.adv_nj, energy.sleep_nj, energy.total_nj);
+    shell_print(shell, "average current %u.%03u uA (estimate)", energy.average_na / 1000, energy.average_na % 1000);
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_config, SHELL_CMD(show, NULL, "Parameters and ranges", cmd_config_show),
+                               SHELL_CMD_ARG(set, NULL, "Change a parameter: set <name> <value>", cmd_config_set, 3, 0),
+                               SHELL_CMD(save, NULL, "Save now instead of after the delay", cmd_config_save),
+                               SHELL_CMD(reset, NULL, "Back to the defaults", cmd_config_reset),
+                               SHELL_CMD(energy, NULL, "Energy per acquisition period", cmd_config_energy), SHELL_SUBCMD_SET_END);
+SHELL_CMD_REGISTER(config, &sub_config, "Acquisition configuration", NULL);
+#endif
+
+#endif
@@ -0,0 +1,187 @@
+/** @file
+ *  @brief Battery monitor code
+ *
+ *  VDD (or VDDH / 5) is measured by the SAADC against the internal 0.6 V
+ *  reference with gain 1/6 (3.6 V full scale), 12 bit, hardware
+ *  oversampling and burst mode so one trigger runs the whole
+ *  oversampling burst without CPU wake-ups.
+ *
+ *  Cost per battery sample with the defaults (16x oversampling, 40 us
+ *  acquisition): about 16 x 42 us = 0.7 ms of SAADC at ~0.7 mA, i.e.
+ *  ~0.5 uC, plus the HFCLK start. Once every 10 minutes that averages to
+ *  about 1 nA, negligible against the sensors.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <device.h>
+#include <drivers/adc.h>
+#include <kernel.h>
+#include <sys/printk.h>
+
+#ifdef CONFIG_ADC_NRFX_SAADC
+#include <hal/nrf_saadc.h>
+#endif
+
+#include <battery.h>
+#include <led_pattern.h>
+#include <pipeline.h>
+
+#ifdef CONFIG_APP_BATTERY
+
+#define BATTERY_ADC_NODE   DT_NODELABEL(adc)
+#define BATTERY_CHANNEL    0
+#define BATTERY_RESOLUTION 12
+#define BATTERY_GAIN       ADC_GAIN_1_6
+#define BATTERY_ACQ_TIME   ADC_ACQ_TIME(ADC_ACQ_TIME_MICROSECONDS, 40)
+
+#ifdef CONFIG_APP_BATTERY_VDDH
+#define BATTERY_INPUT   NRF_SAADC_INPUT_VDDHDIV5
+#define BATTERY_DIVIDER 5
+#elif defined(CONFIG_ADC_NRFX_SAADC)
+#define BATTERY_INPUT   NRF_SAADC_INPUT_VDD
+#define BATTERY_DIVIDER 1
+#else
+#define BATTERY_INPUT   0   // emulator channel
+#define BATTERY_DIVIDER 1
+#endif
+
+/**
+ * @struct battery_point
+ * @brief One point of a discharge curve.
+ * */
+struct battery_point {
+    uint16_t mv;
+    uint8_t percent;
+};
+
+// Discharge curves, decreasing voltage
+#if defined(CONFIG_APP_BATTERY_CURVE_CR2032)
+static const struct battery_point curve[] = {
+    {3000, 100}, {2900, 80}, {2800, 60}, {2700, 40}, {2600, 25}, {2500, 15}, {2300, 5}, {2000, 0},
+};
+#elif defined(CONFIG_APP_BATTERY_CURVE_LIPO)
+static const struct battery_point curve[] = {
+    {4200, 100}, {4100, 90}, {4000, 80}, {3900, 65}, {3800, 50}, {3700, 30}, {3600, 15}, {3500, 5}, {3300, 0},
+};
+#else   // two alkaline AA cells
+static const struct battery_point curve[] = {
+    {3200, 100}, {2900, 90}, {2700, 75}, {2500, 50}, {2400, 35}, {2300, 20}, {2200, 10}, {2000, 0},
+};
+#endif
+
+static const struct device *adc;
+static int16_t sample;
+static struct k_work_delayable battery_work;
+
+static const struct adc_channel_cfg channel_cfg = {
+    .gain = BATTERY_GAIN,
+    .reference = ADC_REF_INTERNAL,
+    .acquisition_time = BATTERY_ACQ_TIME,
+    .channel_id = BATTERY_CHANNEL,
+#ifdef CONFIG_ADC_CONFIGURABLE_INPUTS
+    .input_positive = BATTERY_INPUT,
+#endif
+};
+
+/**
+ * @brief Configure the SAADC channel
+ *
+ * @return int error code
+ */
+int battery_init(void) {
+    int err;
+
+    adc = device_get_binding(DT_LABEL(BATTERY_ADC_NODE));
+    if (adc == NULL) {
+        printk("Error acquiring adc interface\n");
+        return -ENODEV;
+    }
+    err = adc_channel_setup(adc, &channel_cfg);
+    if (err) {
+        printk("Battery channel setup failed (err %d)\n", err);
+        return err;
+    }
+#ifdef CONFIG_ADC_NRFX_SAADC
+    // One START triggers the whole oversampling burst
+    nrf_saadc_burst_set(NRF_SAADC, BATTERY_CHANNEL, NRF_SAADC_BURST_ENABLED);
+#endif
+    return 0;
+}
+
+/**
+ * @brief Measure the battery voltage
+ *
+ * @return int voltage in mV, negative error code
+ */
+int battery_read_mv(void) {
+    const struct adc_sequence sequence = {
+        .channels = BIT(BATTERY_CHANNEL),
+        .buffer = &sample,
+        .buffer_size = sizeof(sample),
+        .resolution = BATTERY_RESOLUTION,
+        .oversampling = CONFIG_APP_BATTERY_OVERSAMPLING,
+    };
+    int32_t mv;
+    int err;
+
+    if (adc == NULL) {
+        return -ENODEV;
+    }
+    err = adc_read(adc, &sequence);
+    if (err) {
+        return err;
+    }
+    mv = MAX(sample, 0);
+    adc_raw_to_millivolts(adc_ref_internal(adc), BATTERY_GAIN, BATTERY_RESOLUTION, &mv);
+    return mv * BATTERY_DIVIDER;
+}
+
+/**
+ * @brief State of charge from the discharge curve
+ *
+ * @param mv battery voltage in mV
+ * @return uint8_t percentage, linear between the points of the curve
+ */
+uint8_t battery_percent(int mv) {
+    if (mv >= curve[0].mv) {
+        return curve[0].percent;
+    }
+    for (int i = 1; i < ARRAY_SIZE(curve); i++) {
+        if (mv >= curve[i].mv) {
+            return curve[i].percent + (mv - curve[i].mv) * (curve[i - 1].percent - curve[i].percent) / (curve[i - 1].mv - curve[i].mv);
+        }
+    }
+    return curve[ARRAY_SIZE(curve) - 1].percent;
+}
+
+static void battery_handler(struct k_work *work) {
+    uint32_t start = k_cycle_get_32();
+    int mv = battery_read_mv();
+
+    if (mv >= 0) {
+        uint8_t percent = battery_percent(mv);
+
+        pipeline_push(PIPELINE_VOLTAGE, mv, start);
+        pipeline_push(PIPELINE_BATTERY, percent, start);
+#ifdef CONFIG_APP_LED_PATTERN
+        led_pattern_set(LED_PATTERN_LOW_BATTERY, percent <= CONFIG_APP_BATTERY_LOW_PERCENT);
+#endif
+    }
+    k_work_schedule(&battery_work, K_SECONDS(CONFIG_APP_BATTERY_PERIOD_S));
+}
+
+/**
+ * @brief Start the periodic battery measure
+ *
+ */
+void battery_start(void) {
+    k_work_init_delayable(&battery_work, battery_handler);
+    k_work_schedule(&battery_work, K_NO_WAIT);
+}
+
+#endif
@@ -1,5 +1,11 @@
 /** @file
  *  @brief Bmp180 Service code
+ *
+ *  A conversion ends when the SCO bit of CTRL_MEAS clears, or on the EOC
+ *  pin rising edge when a bmp180-eoc alias is wired. The status is first
+ *  checked at 60 % of the datasheet maximum conversion time, then with a
+ *  doubling sleep, until CONFIG_APP_BMP180_TIMEOUT_MS. The measured time is
+ *  accounted against the fixed sleep it replaces.
  */
 
 /*
@@ -10,12 +16,15 @@
 
 #include "bmp180.h"
 #include <device.h>
+#include <kernel.h>
 #include <drivers/gpio.h>
 #include <drivers/i2c.h>
 #include <drivers/spi.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/printk.h>
+#include <trace.h>
 
 // Registers
 #define CALIB     0xAA
@@ -25,12 +34,34 @@
 #define OUT_MSB   0xF6
 #define OUT_LSB   0xF7
 #define OUT_XLSB  0xF8
+#define CTRL_SCO  0x20
+#define CMD_TEMP  0x2E
+#define CMD_PRESS 0x34
+
+#define T_CONV_TEMP_US      4500
+#define POLL_FIRST_PERMILLE 600   // first status read at 60 % of the maximum conversion time
+#define POLL_STEP_US        250   // then sleep 250 us, 500 us, ... up to a quarter of it
 
 // Private defines
 #define convert8bitto16bit(x, y) (((x) << 8) | (y))
 #define powerof2(x)              (1 << (x))
 
+#define EOC_NODE DT_ALIAS(bmp180_eoc)
+#if defined(CONFIG_APP_BMP180_WAIT_DETECT) && defined(CONFIG_GPIO) && DT_NODE_HAS_STATUS(EOC_NODE, okay)
+#define BMP180_EOC
+static const struct gpio_dt_spec eoc = GPIO_DT_SPEC_GET(EOC_NODE, gpios);
+static struct gpio_callback eoc_cb;
+static K_SEM_DEFINE(eoc_sem, 0, 1);
+#endif
+
 static uint8_t id = 0;
+static uint8_t calibration[BMP180_CALIB_LEN];
+
+static const uint16_t t_conv_press_us[4] = {4500, 7500, 13500, 25500};   // datasheet maximum, per oss
+static const uint8_t fixed_wait_ms[4] = {5, 8, 14, 26};                 // sleeps before conversion detection
+static bmp180_conversion_t conversion;
+static uint64_t conversion_total_us;
+static uint64_t fixed_total_us;
 
 static const struct device *i2c;
 bmp180_t bmp180;
@@ -59,23 +90,17 @@ int bmp180_writeRegister(uint8_t RegNum, uint8_t Value) {
 }
 
 /**
- * @brief Read calibration data from bmp180
+ * @brief Check and store calibration data
  *
+ * @param CalibrationData raw calibration registers 0xAA to 0xBF
+ * @return int error code
  */
-void bmp180_readCalibrationData() {
-    uint8_t CalibrationData[26];
-    int i;
-#define CAL_START 0xAA   // Defining the address where the calibration data should start
-    for (i = 0; i < 22; i++) {
-        // Read calibration table
-        bmp180_readRegister(CAL_START + i, &CalibrationData[i]);
-    }
-
-    for (uint8_t i = 0; i < 22; i += 2) {
+static int bmp180_applyCalibrationData(const uint8_t *CalibrationData) {
+    for (uint8_t i = 0; i < BMP180_CALIB_LEN; i += 2) {
         uint16_t combined_calibration_data = convert8bitto16bit(CalibrationData[i], CalibrationData[i + 1]);
         if (combined_calibration_data == 0x00 || combined_calibration_data == 0XFF) {
             printk("Error calibration setting \r\n");
-            return;
+            return -EINVAL;
         }
     }
 
@@ -116,56 +141,212 @@ void bmp180_readCalibrationData() {
     bmp180.MC = convert8bitto16bit(CalibrationData[18], CalibrationData[19]);
     bmp180.MD = convert8bitto16bit(CalibrationData[20], CalibrationData[21]);
     bmp180.sea_pressure = 101325;
+    memcpy(calibration, CalibrationData, BMP180_CALIB_LEN);
+    return 0;
 }
 
 /**
- * @brief read up data from bmp180
+ * @brief Read calibration data from bmp180
  *
- * @return int32_t return up value
  */
-static int32_t bmp180_read_up() {
-    uint8_t write_data = 0x34 + (bmp180.oss << 6), up_data[3];
-    bmp180_writeRegister(CTRL_MEAS, write_data);
-    uint8_t wait = 0;
-    switch (bmp180.oversampling_setting) {
-    case ultra_low_power:
-        wait = 5;
-        break;
-    case standart:
-        wait = 8;
-        break;
-    case high_resolution:
-        wait = 14;
-        break;
-    case ultra_high_resolution:
-        wait = 26;
-        break;
-    default:
-        wait = 5;
-        break;
+void bmp180_readCalibrationData() {
+    uint8_t CalibrationData[BMP180_CALIB_LEN];
+
+    // Read the whole calibration table in one burst
+    if (i2c_burst_read(i2c, BMP180_R_ADDRESS, CALIB, CalibrationData, BMP180_CALIB_LEN) != 0) {
+        printk("Error reading calibration \r\n");
+        return;
+    }
+    bmp180_applyCalibrationData(CalibrationData);
+}
+
+/**
+ * @brief Select the pressure oversampling, used from the next read
+ *
+ * @param setting ultra_low_power to ultra_high_resolution
+ * @return int error code
+ */
+int bmp180_setOversampling(enum _bmp180_oversampling_settings setting) {
+    if (setting > ultra_high_resolution) {
+        return -EINVAL;
+    }
+    bmp180.oversampling_setting = setting;
+    bmp180.oss = setting;
+    return 0;
+}
+
+#ifdef BMP180_EOC
+static void bmp180_eoc_handler(const struct device *dev, struct gpio_callback *cb, uint32_t pins) {
+    k_sem_give(&eoc_sem);
+}
+
+/**
+ * @brief Configure the EOC pin interrupt
+ *
+ * @return int error code
+ */
+static int bmp180_eoc_init() {
+    int ret;
+
+    if (!device_is_ready(eoc.port)) {
+        return -ENODEV;
+    }
+    ret = gpio_pin_configure_dt(&eoc, GPIO_INPUT);
+    if (ret != 0) {
+        return ret;
+    }
+    gpio_init_callback(&eoc_cb, bmp180_eoc_handler, BIT(eoc.pin));
+    gpio_add_callback(eoc.port, &eoc_cb);
+    return gpio_pin_interrupt_configure_dt(&eoc, GPIO_INT_EDGE_TO_ACTIVE);
+}
+#endif
+
+#ifdef CONFIG_APP_BMP180_WAIT_DETECT
+/**
+ * @brief Wait for the SCO bit to clear
+ *
+ * @param max_us datasheet maximum conversion time
+ * @return int error code, -ETIMEDOUT after CONFIG_APP_BMP180_TIMEOUT_MS
+ */
+static int bmp180_poll(uint32_t max_us) {
+    int64_t deadline = k_uptime_get() + CONFIG_APP_BMP180_TIMEOUT_MS;
+    int32_t step = POLL_STEP_US;
+    uint8_t ctrl;
+
+    k_usleep(max_us * POLL_FIRST_PERMILLE / 1000);
+    for (;;) {
+        conversion.polls++;
+        if (bmp180_readRegister(CTRL_MEAS, &ctrl) == 0 && !(ctrl & CTRL_SCO)) {
+            return 0;
+        }
+        if (k_uptime_get() >= deadline) {
+            return -ETIMEDOUT;
+        }
+        k_usleep(step);
+        step = MIN(step * 2, MAX(max_us / 4, POLL_STEP_US));
+    }
+}
+#endif
+
+/**
+ * @brief Start a conversion and wait for its end
+ *
+ * @param cmd CTRL_MEAS command
+ * @param max_us datasheet maximum conversion time
+ * @param fixed_ms sleep used without conversion detection
+ * @return int error code
+ */
+static int bmp180_convert(uint8_t cmd, uint32_t max_us, uint8_t fixed_ms) {
+    uint32_t start = k_cycle_get_32();
+    uint32_t elapsed;
+    int err;
+
+#ifdef BMP180_EOC
+    k_sem_reset(&eoc_sem);
+#endif
+    err = bmp180_writeRegister(CTRL_MEAS, cmd);
+    if (err) {
+        return err;
+    }
+    TRACE_BEGIN(TRACE_STAGE_WAIT);
+#if defined(BMP180_EOC)
+    err = k_sem_take(&eoc_sem, K_MSEC(CONFIG_APP_BMP180_TIMEOUT_MS)) ? -ETIMEDOUT : 0;
+#elif defined(CONFIG_APP_BMP180_WAIT_DETECT)
+    err = bmp180_poll(max_us);
+#else
+    k_msleep(fixed_ms);
+#endif
+    TRACE_END(TRACE_STAGE_WAIT);
+
+    elapsed = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    if (err) {
+        conversion.timeouts++;
+        return err;
     }
-    k_msleep(wait);
-    bmp180_readRegister(OUT_MSB, &up_data[0]);
-    bmp180_readRegister(OUT_MSB + 1, &up_data[1]);
-    bmp180_readRegister(OUT_MSB + 2, &up_data[2]);
+    conversion.count++;
+    conversion.max_us = MAX(conversion.max_us, elapsed);
+    conversion_total_us += elapsed;
+    fixed_total_us += fixed_ms * USEC_PER_MSEC;
+    return 0;
+}
+
+/**
+ * @brief read up data from bmp180
+ *
+ * The command, the wait and the shift all use bmp180.oss.
+ *
+ * @param up pointer to returned up value
+ * @return int error code
+ */
+static int bmp180_read_up(int32_t *up) {
+    uint8_t up_data[3];
+    int err;
 
-    return ((up_data[0] << 16) + (up_data[1] << 8) + up_data[2]) >> (8 - bmp180.oss);
+    err = bmp180_convert(CMD_PRESS + (bmp180.oss << 6), t_conv_press_us[bmp180.oss], fixed_wait_ms[bmp180.oss]);
+    if (err) {
+        return err;
+    }
+    err = i2c_burst_read(i2c, BMP180_R_ADDRESS, OUT_MSB, up_data, sizeof(up_data));
+    if (err) {
+        return err;
+    }
+    *up = ((up_data[0] << 16) + (up_data[1] << 8) + up_data[2]) >> (8 - bmp180.oss);
+    return 0;
 }
 
 /**
  * @brief read ut data frol bmp180
  *
- * @return int16_t return ut data
+ * @param ut pointer to returned ut value
+ * @return int error code
  */
-static int16_t bmp180_read_ut() {
-    uint8_t write_data = 0x2E, ut_data[2];
+static int bmp180_read_ut(int16_t *ut) {
+    uint8_t ut_data[2];
+    int err;
 
-    bmp180_writeRegister(CTRL_MEAS, write_data);
-    k_msleep(5);
-    bmp180_readRegister(OUT_MSB, &ut_data[0]);
-    bmp180_readRegister(OUT_MSB + 1, &ut_data[1]);
+    err = bmp180_convert(CMD_TEMP, T_CONV_TEMP_US, 5);
+    if (err) {
+        return err;
+    }
+    err = i2c_burst_read(i2c, BMP180_R_ADDRESS, OUT_MSB, ut_data, sizeof(ut_data));
+    if (err) {
+        return err;
+    }
+    *ut = convert8bitto16bit(ut_data[0], ut_data[1]);
+    return 0;
+}
+
+/**
+ * @brief Conversion time measured against the fixed sleeps
+ *
+ * @param stats pointer to returned statistics
+ */
+void bmp180_conversion_get(bmp180_conversion_t *stats) {
+    *stats = conversion;
+    if (conversion.count) {
+        stats->avg_us = (uint32_t) (conversion_total_us / conversion.count);
+        stats->fixed_us = (uint32_t) (fixed_total_us / conversion.count);
+    }
+}
 
-    return (convert8bitto16bit(ut_data[0], ut_data[1]));
+/**
+ * @brief Bind the I2C bus used by the bmp180
+ *
+ * @return int error code
+ */
+static int bmp180_bind() {
+    i2c = device_get_binding("I2C_0");
+    if (i2c == NULL) {
+        printk("Error acquiring i2c1 interface\n");
+        return -1;
+    }
+#ifdef BMP180_EOC
+    if (bmp180_eoc_init() != 0) {
+        printk("Error configuring the bmp180 EOC pin\n");
+        return -1;
+    }
+#endif
+    return 0;
 }
 
 /**
@@ -175,9 +356,7 @@ static int16_t bmp180_read_ut() {
  */
 int bmp180_begin() {
     // Set up the I2C interface
-    i2c = device_get_binding("I2C_0");
-    if (i2c == NULL) {
-        printk("Error acquiring i2c1 interface\n");
+    if (bmp180_bind() != 0) {
         return -1;
     }
     bmp180_writeRegister(0xE0, 0x86);
@@ -199,15 +378,56 @@ int bmp180_begin() {
     return 0;
 }
 
+/**
+ * @brief init bmp180 from cached calibration data
+ *
+ * Only the chip id is read to check the cache still matches the hardware.
+ *
+ * @param expected_id chip id stored with the calibration
+ * @param CalibrationData raw calibration registers 0xAA to 0xBF
+ * @return int error code, -ENODEV when the chip id differs
+ */
+int bmp180_beginCached(uint8_t expected_id, const uint8_t *CalibrationData) {
+    if (bmp180_bind() != 0) {
+        return -1;
+    }
+    if (bmp180_readRegister(ID, &id) != 0 || id != expected_id) {
+        return -ENODEV;
+    }
+    return bmp180_applyCalibrationData(CalibrationData);
+}
+
+/**
+ * @brief chip id read by the last begin
+ *
+ * @return uint8_t chip id
+ */
+uint8_t bmp180_getId() {
+    return id;
+}
+
+/**
+ * @brief raw calibration registers in use
+ *
+ * @param CalibrationData output buffer of BMP180_CALIB_LEN bytes
+ */
+void bmp180_getCalibrationData(uint8_t *CalibrationData) {
+    memcpy(CalibrationData, calibration, BMP180_CALIB_LEN);
+}
+
 /**
  * @brief read temperature from bmp180
  *
  * @return int32_t temperature
  */
 int32_t bmp180_readTemperature() {
-    int16_t ut = bmp180_read_ut();
+    int16_t ut;
     int32_t X1, X2;
 
+    if (bmp180_read_ut(&ut) != 0) {
+        return ((int32_t) bmp180.temperature * 100);   // last value
+    }
+
     X1 = (ut - bmp180.AC6) * bmp180.AC5 / powerof2(15);
     X2 = bmp180.MC * powerof2(11) / (X1 + bmp180.MD);
     bmp180.B5 = X1 + X2;
@@ -221,7 +441,11 @@ int32_t bmp180_readTemperature() {
  * @return int32_t pressure
  */
 int32_t bmp180_readPressure() {
-    int32_t X1, X2, X3, up = bmp180_read_up(bmp180), p;
+    int32_t X1, X2, X3, up, p;
+
+    if (bmp180_read_up(&up) != 0) {
+        return bmp180.pressure;   // last value
+    }
     bmp180.B6 = bmp180.B5 - 4000;
     X1 = (bmp180.B2 * (bmp180.B6 * bmp180.B6 / powerof2(12))) / powerof2(11);
     X2 = bmp180.AC2 * bmp180.B6 / powerof2(11);
@@ -0,0 +1,127 @@
+/** @file
+ *  @brief Boot cache code
+ *
+ *  A cold boot scans the I2C bus, probes and calibrates the sensors, then
+ *  saves the BMP180 chip id and calibration in settings. A warm boot reads
+ *  the chip id to check the cache still matches the hardware and skips the
+ *  scan and the calibration dump. The scan map itself is not kept: with
+ *  the chip id read a warm boot has nothing left to look up in it.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <kernel.h>
+#include <settings/settings.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/crc.h>
+#include <sys/printk.h>
+
+#include <am2320.h>
+#include <boot_cache.h>
+
+#define BOOT_CACHE_KEY "app/boot"
+
+static boot_cache_t cache;
+static bool cache_loaded;
+
+static int boot_cache_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg) {
+    const char *next;
+
+    if (settings_name_steq(name, "boot", &next) && !next) {
+        if (len != sizeof(cache)) {
+            return -EINVAL;
+        }
+        cache_loaded = read_cb(cb_arg, &cache, sizeof(cache)) == sizeof(cache);
+        return 0;
+    }
+    return -ENOENT;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(app_boot, "app", NULL, boot_cache_set, NULL, NULL);
+
+static uint32_t boot_cache_crc(const boot_cache_t *c) {
+    return crc32_ieee((const uint8_t *) c, offsetof(boot_cache_t, crc));
+}
+
+/**
+ * @brief Load the cache from settings and check it
+ *
+ * @return int 0 when a valid cache was loaded
+ */
+static int boot_cache_load(void) {
+    int err;
+
+    err = settings_subsys_init();
+    if (err) {
+        printk("settings init failed (err %d)\n", err);
+        return err;
+    }
+    settings_load_subtree("app/boot");
+    if (!cache_loaded || cache.version != BOOT_CACHE_VERSION || cache.crc != boot_cache_crc(&cache)) {
+        return -ENOENT;
+    }
+    return 0;
+}
+
+/**
+ * @brief Erase the cache so the next boot is a cold boot
+ *
+ * @return int error code
+ */
+int boot_cache_clear(void) {
+    cache_loaded = false;
+    return settings_delete(BOOT_CACHE_KEY);
+}
+
+/**
+ * @brief Full probe of the bus and the sensors, then save the cache
+ */
+static void boot_cold(void) {
+    static const char *const bus[] = {"I2C_0", "I2C_1"};
+    i2c_scan_result_t scan[ARRAY_SIZE(bus)];
+
+    memset(&cache, 0, sizeof(cache));
+    i2c_scan_buses(bus, ARRAY_SIZE(bus), 0, scan);
+    for (int i = 0; i < ARRAY_SIZE(bus); i++) {
+        if (scan[i].duration_us) {
+            printk("i2c scan %s: %u devices in %u us\n", scan[i].bus, scan[i].count, scan[i].duration_us);
+        }
+    }
+    bmp180_begin();
+
+    cache.version = BOOT_CACHE_VERSION;
+    cache.bmp_id = bmp180_getId();
+    bmp180_getCalibrationData(cache.bmp180_calib);
+    cache.crc = boot_cache_crc(&cache);
+    if (!i2c_map_test(scan[0].map, BMP180_R_ADDRESS)) {
+        return;   // nothing worth caching
+    }
+    if (settings_save_one(BOOT_CACHE_KEY, &cache, sizeof(cache)) != 0) {
+        printk("boot cache save failed\n");
+    }
+}
+
+/**
+ * @brief Bring up the sensors, from the boot cache when it is valid
+ *
+ * @return true warm boot, false cold boot
+ */
+bool boot_sensors_begin(void) {
+    uint32_t start = k_cycle_get_32();
+    bool warm = false;
+
+    if (boot_cache_load() == 0 && bmp180_beginCached(cache.bmp_id, cache.bmp180_calib) == 0) {
+        warm = true;
+    } else {
+        boot_cold();
+    }
+    am2320_begin();   // no cheap id read, a wrong cache shows up as CRC errors
+
+    printk("boot: %s, sensors ready in %u us\n", warm ? "warm" : "cold", k_cyc_to_us_floor32(k_cycle_get_32() - start));
+    return warm;
+}
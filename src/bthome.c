@@ -0,0 +1,153 @@
+/** @file
+ *  @brief BTHome v2 encoder and decoder code
+ *
+ *  No Zephyr dependency: the host tools build this file as is.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <errno.h>
+#include <stdint.h>
+
+#include <bthome.h>
+
+/**
+ * @brief Size of the value of an object
+ *
+ * @param id object id
+ * @return int value size in bytes, -ENOTSUP for unknown objects
+ */
+int bthome_object_size(uint8_t id) {
+    switch (id) {
+    case BTHOME_PACKET_ID:
+    case BTHOME_BATTERY:
+    case BTHOME_BUTTON:
+        return 1;
+    case BTHOME_TEMPERATURE:
+    case BTHOME_HUMIDITY:
+    case BTHOME_DEW_POINT:
+    case BTHOME_VOLTAGE:
+    case BTHOME_DISTANCE_M:
+        return 2;
+    case BTHOME_PRESSURE:
+        return 3;
+    default:
+        return -ENOTSUP;
+    }
+}
+
+/**
+ * @brief Start a service data payload: UUID and device information
+ *
+ * @param buf encoder state
+ * @param data output buffer
+ * @param size size of data
+ */
+void bthome_begin(bthome_buf_t *buf, uint8_t *data, size_t size) {
+    buf->data = data;
+    buf->size = size;
+    buf->data[0] = BTHOME_SERVICE_UUID & 0xff;
+    buf->data[1] = BTHOME_SERVICE_UUID >> 8;
+    buf->data[2] = BTHOME_DEVICE_INFO;
+    buf->len = 3;
+}
+
+/**
+ * @brief Append an object, little endian
+ *
+ * @param buf encoder state
+ * @param id object id
+ * @param value value in the object unit
+ * @return int error code, -ENOMEM when the object does not fit
+ */
+int bthome_add(bthome_buf_t *buf, uint8_t id, int32_t value) {
+    int size = bthome_object_size(id);
+
+    if (size < 0) {
+        return size;
+    }
+    if (buf->len + 1 + size > buf->size) {
+        return -ENOMEM;
+    }
+    buf->data[buf->len++] = id;
+    for (int i = 0; i < size; i++) {
+        buf->data[buf->len++] = (value >> (8 * i)) & 0xff;
+    }
+    return 0;
+}
+
+/**
+ * @brief Start parsing a service data payload
+ *
+ * @param reader decoder state
+ * @param data service data: UUID, device information and objects
+ * @param len size of data
+ * @return int device information byte, -EINVAL when not BTHome v2, -ENOTSUP when encrypted
+ */
+int bthome_parse_begin(bthome_reader_t *reader, const uint8_t *data, size_t len) {
+    if (len < 3 || len > UINT8_MAX || (data[0] | (data[1] << 8)) != BTHOME_SERVICE_UUID || BTHOME_INFO_VERSION(data[2]) != 2) {
+        return -EINVAL;
+    }
+    if (data[2] & BTHOME_INFO_ENCRYPTED) {
+        return -ENOTSUP;
+    }
+    reader->data = data;
+    reader->len = len;
+    reader->pos = 3;
+    return data[2];
+}
+
+/**
+ * @brief Get the next object
+ *
+ * Parsing stops at the first unknown object since its size is unknown.
+ *
+ * @param reader decoder state
+ * @param object set to the object found
+ * @return int 1 when an object was found, 0 at the end, -EBADMSG when truncated, -ENOTSUP for an unknown object
+ */
+int bthome_parse_next(bthome_reader_t *reader, bthome_object_t *object) {
+    int size;
+
+    if (reader->pos >= reader->len) {
+        return 0;
+    }
+    size = bthome_object_size(reader->data[reader->pos]);
+    if (size < 0) {
+        return size;
+    }
+    if (reader->pos + 1 + size > reader->len) {
+        return -EBADMSG;
+    }
+    object->id = reader->data[reader->pos];
+    object->size = size;
+    object->value = &reader->data[reader->pos + 1];
+    reader->pos += 1 + size;
+    return 1;
+}
+
+/**
+ * @brief Value of an object, sign extended for the signed objects
+ *
+ * @param object parsed object
+ * @return int32_t value in the object unit, as given to bthome_add()
+ */
+int32_t bthome_object_value(const bthome_object_t *object) {
+    uint32_t value = 0;
+    int shift = 32 - 8 * object->size;
+
+    for (int i = 0; i < object->size; i++) {
+        value |= (uint32_t) object->value[i] << (8 * i);
+    }
+    switch (object->id) {
+    case BTHOME_TEMPERATURE:
+    case BTHOME_DEW_POINT:
+        return (int32_t) (value << shift) >> shift;
+    default:
+        return value;
+    }
+}
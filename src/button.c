@@ -13,12 +13,6 @@
 #include <kernel.h>
 #include <logging/log.h>
 
-#include <bluetooth/bluetooth.h>
-#include <bluetooth/conn.h>
-#include <bluetooth/gatt.h>
-#include <bluetooth/hci.h>
-#include <bluetooth/uuid.h>
-
 LOG_MODULE_REGISTER(button_svc);
 
 static const struct gpio_dt_spec button = GPIO_DT_SPEC_GET(DT_ALIAS(sw0), gpios);
@@ -46,7 +40,7 @@ int button_init(gpio_callback_handler_t handler) {
 
     gpio_init_callback(&gpio_cb, handler, BIT(button.pin));
     gpio_add_callback(button.port, &gpio_cb);
-    ret = gpio_pin_interrupt_configure_dt(&button, GPIO_INT_EDGE_TO_ACTIVE);
+    ret = gpio_pin_interrupt_configure_dt(&button, GPIO_INT_EDGE_BOTH);
     if (ret != 0) {
         LOG_ERR("Error %d: can't configure button interrupt on "
                 "GPIO %s pin %d",
@@ -54,4 +48,13 @@ int button_init(gpio_callback_handler_t handler) {
         return ret;
     }
     return 0;
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Read the button level
+ *
+ * @return int 1 when pressed, 0 when released, negative error code
+ */
+int button_get(void) {
+    return gpio_pin_get_dt(&button);
+}
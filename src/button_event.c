@@ -0,0 +1,177 @@
+/** @file
+ *  @brief Button event code
+ *
+ *  The GPIO interrupt only timestamps the edge and submits a work item to a
+ *  dedicated cooperative work queue, which debounces the level and
+ *  classifies press, double press and long press. The event goes to the
+ *  encoder through the pipeline like any other channel, so the sensor
+ *  threads are never involved.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <kernel.h>
+#include <sys/atomic.h>
+#include <sys/printk.h>
+
+#include <bthome.h>
+#include <button.h>
+#include <button_event.h>
+#include <pipeline.h>
+
+#ifdef CONFIG_APP_BUTTON
+
+#define BUTTON_STACK 768
+#define BUTTON_PRIO  K_PRIO_COOP(2)   // above the advertising work queue
+
+static K_THREAD_STACK_DEFINE(button_stack, BUTTON_STACK);
+static struct k_work_q button_workq;
+static struct k_work edge_work;               // edge seen by the ISR
+static struct k_work_delayable settle_work;   // level check at the end of the debounce time
+static struct k_work_delayable click_work;    // long press threshold or double press window
+
+static atomic_t edge_cycle;   // k_cycle_get_32() of the last edge
+
+// Owned by the work queue
+static bool pressed;
+static uint32_t changed_ms;      // uptime of the last accepted level change
+static uint32_t changed_cycle;   // k_cycle_get_32() of the edge behind that change
+static bool clicked;             // released, waiting for a second press
+static bool ignore_release;      // release of a double or long press
+static button_stats_t stats;
+
+/**
+ * @brief Hand the event to the encoder
+ *
+ * @param event BTHOME_BUTTON_*
+ * @param since k_cycle_get_32() of the edge behind the event
+ */
+static void button_emit(uint8_t event, uint32_t since) {
+    switch (event) {
+    case BTHOME_BUTTON_PRESS:
+        stats.press++;
+        break;
+    case BTHOME_BUTTON_DOUBLE_PRESS:
+        stats.double_press++;
+        break;
+    case BTHOME_BUTTON_LONG_PRESS:
+        stats.long_press++;
+        break;
+    }
+    pipeline_push(PIPELINE_BUTTON, event, since);
+}
+
+/**
+ * @brief Debounce the button level and run the classification
+ *
+ * A level change is accepted right away, so the press edge costs no
+ * debounce delay, then the level is ignored for CONFIG_APP_BUTTON_DEBOUNCE_MS
+ * and checked again at the end of that time.
+ *
+ * @param since k_cycle_get_32() of the last edge
+ */
+static void button_sample(uint32_t since) {
+    uint32_t now = k_uptime_get_32();
+    int level = button_get();
+    uint32_t elapsed = now - changed_ms;
+
+    if (level < 0 || level == pressed) {
+        return;
+    }
+    if (elapsed < CONFIG_APP_BUTTON_DEBOUNCE_MS) {
+        stats.bounces++;
+        k_work_reschedule_for_queue(&button_workq, &settle_work, K_MSEC(CONFIG_APP_BUTTON_DEBOUNCE_MS - elapsed));
+        return;
+    }
+    pressed = level;
+    changed_ms = now;
+    changed_cycle = since;
+
+    if (pressed) {
+        if (clicked) {
+            clicked = false;
+            ignore_release = true;
+            k_work_cancel_delayable(&click_work);
+            button_emit(BTHOME_BUTTON_DOUBLE_PRESS, since);
+        } else {
+            k_work_reschedule_for_queue(&button_workq, &click_work, K_MSEC(CONFIG_APP_BUTTON_LONG_MS));
+        }
+    } else {
+        k_work_cancel_delayable(&click_work);
+        if (ignore_release) {
+            ignore_release = false;
+        } else {
+            clicked = true;
+            k_work_reschedule_for_queue(&button_workq, &click_work, K_MSEC(CONFIG_APP_BUTTON_DOUBLE_MS));
+        }
+    }
+}
+
+static void button_edge(struct k_work *work) {
+    button_sample(atomic_get(&edge_cycle));
+}
+
+static void button_settle(struct k_work *work) {
+    button_sample(atomic_get(&edge_cycle));   // the level settled after the last bounce
+}
+
+/**
+ * @brief Long press threshold reached or double press window expired
+ *
+ * The events are timed from the edge that completed them, the press edge
+ * for a long press and the release edge for a press, not from the timeout
+ * that classified them.
+ *
+ * @param work unused
+ */
+static void button_click(struct k_work *work) {
+    if (pressed) {
+        ignore_release = true;
+        button_emit(BTHOME_BUTTON_LONG_PRESS, changed_cycle);
+    } else if (clicked) {
+        clicked = false;
+        button_emit(BTHOME_BUTTON_PRESS, changed_cycle);
+    }
+}
+
+static void button_isr(const struct device *dev, struct gpio_callback *cb, uint32_t pins) {
+    atomic_set(&edge_cycle, k_cycle_get_32());
+    stats.edges++;
+    k_work_submit_to_queue(&button_workq, &edge_work);
+}
+
+/**
+ * @brief Start the button work queue and enable the interrupt
+ *
+ * @return int error code
+ */
+int button_event_init(void) {
+    int err;
+
+    k_work_queue_start(&button_workq, button_stack, K_THREAD_STACK_SIZEOF(button_stack), BUTTON_PRIO, NULL);
+    k_thread_name_set(&button_workq.thread, "button");
+    k_work_init(&edge_work, button_edge);
+    k_work_init_delayable(&settle_work, button_settle);
+    k_work_init_delayable(&click_work, button_click);
+
+    err = button_init(button_isr);
+    if (err) {
+        printk("Button init failed (err %d)\n", err);
+    }
+    return err;
+}
+
+/**
+ * @brief Get the classification counters
+ *
+ * @param out counters
+ */
+void button_event_get(button_stats_t *out) {
+    *out = stats;
+}
+
+#endif
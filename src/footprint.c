@@ -0,0 +1,95 @@
+/** @file
+ *  @brief Footprint report code
+ *
+ *  Prints the stack high-water mark of every thread and an estimate of the
+ *  average current, and flags them against the Kconfig thresholds. Flash
+ *  and RAM are checked at build time by size_report.py.
+ *
+ *  The current is a model, not a measure: sleep current plus CPU active
+ *  share times the run current plus the charge of one advertising event
+ *  per interval, with nRF52840 product specification figures (DCDC on,
+ *  0 dBm). The sensors are not included.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <kernel.h>
+#include <sys/printk.h>
+
+#include <adv.h>
+#include <footprint.h>
+
+#ifdef CONFIG_APP_FOOTPRINT
+
+static struct k_work_delayable footprint_work;
+static uint64_t last_cycles;
+static uint32_t last_stamp;
+static uint32_t current_ua;
+static uint32_t cpu_permille;
+
+static void footprint_stack(const struct k_thread *thread, void *user_data) {
+    const char *name = k_thread_name_get((k_tid_t) thread);
+    size_t size = thread->stack_info.size;
+    size_t unused = 0;
+    size_t used;
+
+    if (k_thread_stack_space_get(thread, &unused) != 0) {
+        return;
+    }
+    used = size - unused;
+    printk("footprint: stack %-10s %4u/%4u%s\n", name ? name : "?", used, size,
+           unused * 100 < size * CONFIG_APP_FOOTPRINT_STACK_MARGIN ? " LOW" : "");
+}
+
+/**
+ * @brief Update the CPU share and the current estimate
+ *
+ */
+static void footprint_current(void) {
+    k_thread_runtime_stats_t rt;
+    uint32_t now = k_cycle_get_32();
+    uint64_t elapsed = MAX(now - last_stamp, 1);
+
+    k_thread_runtime_stats_all_get(&rt);
+    cpu_permille = (uint32_t) ((rt.execution_cycles - last_cycles) * 1000 / elapsed);
+    last_cycles = rt.execution_cycles;
+    last_stamp = now;
+    current_ua = (FOOTPRINT_SLEEP_NA + cpu_permille * FOOTPRINT_CPU_UA + FOOTPRINT_ADV_CHARGE_NC * MSEC_PER_SEC / adv_interval_ms()) / 1000;
+}
+
+static void footprint_report(struct k_work *work) {
+    k_thread_foreach(footprint_stack, NULL);
+    footprint_current();
+    printk("footprint: cpu %u.%u %%, average current %u uA (estimate)%s\n", cpu_permille / 10, cpu_permille % 10, current_ua,
+           current_ua > CONFIG_APP_FOOTPRINT_CURRENT_UA_MAX ? " HIGH" : "");
+    k_work_schedule(&footprint_work, K_SECONDS(CONFIG_APP_FOOTPRINT_PERIOD_S));
+}
+
+/**
+ * @brief Report periodically, the first report after one period
+ *
+ */
+void footprint_start(void) {
+    k_thread_runtime_stats_t rt;
+
+    k_thread_runtime_stats_all_get(&rt);
+    last_cycles = rt.execution_cycles;
+    last_stamp = k_cycle_get_32();
+    k_work_init_delayable(&footprint_work, footprint_report);
+    k_work_schedule(&footprint_work, K_SECONDS(CONFIG_APP_FOOTPRINT_PERIOD_S));
+}
+
+/**
+ * @brief Last average current estimate
+ *
+ * @return uint32_t current in uA, 0 before the first report
+ */
+uint32_t footprint_current_ua(void) {
+    return current_ua;
+}
+
+#endif
@@ -0,0 +1,173 @@
+/** @file
+ *  @brief Temperature fusion code
+ *
+ *  Scalar Kalman filter in fixed point combining the BMP180 and AM2320
+ *  temperatures. Each source has its own measurement noise and a slowly
+ *  learnt bias (the biases are kept zero mean, only their difference is
+ *  observable). Measurements further than FUSION_GATE sigmas from the
+ *  estimate are rejected, until every source disagrees with it: after
+ *  REJECT_RUN rejections in a row, with at least one from each of the other
+ *  sources, the step is real and the filter starts again from the measure.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <fusion.h>
+
+// Values are 0.01 degC in Q8, variances (0.01 degC)^2 in Q8
+#define Q           8
+#define PROCESS_VAR (25 << Q)   // (0.05 degC)^2 per second
+#define FUSION_GATE 4           // outlier gate in standard deviations
+#define BIAS_RATE   64          // bias learning time constant, in updates
+#define STABLE_RUN  8           // consistent updates before the estimate is stable
+#define STABLE_VAR  (400 << Q)  // (0.2 degC)^2
+#define REJECT_RUN  4           // consecutive rejections of a source before a step is accepted
+#define MAX_VAR     (INT32_MAX / 2)  // variance ceiling, keeps p + meas_var in range
+
+// Measurement noise: the BMP180 driver returns whole degrees (quantization
+// 100^2 / 12) on top of +/-1 degC accuracy, the AM2320 has 0.1 degC resolution.
+static const int32_t meas_var[FUSION_SOURCE_COUNT] = {1600 << Q, 400 << Q};
+
+static struct {
+    bool valid;
+    int32_t x;                              // estimate
+    int32_t p;                              // estimate variance
+    int32_t bias[FUSION_SOURCE_COUNT];
+    int64_t last;                           // time of the last update, ms
+    uint32_t run;                           // consecutive consistent updates
+    uint32_t rejects[FUSION_SOURCE_COUNT];  // consecutive rejections of each source
+    uint32_t accepted;
+    uint32_t rejected;
+    uint32_t steps;
+} f;
+
+/**
+ * @brief Forget the estimate and the learnt biases
+ *
+ */
+void fusion_reset(void) {
+    memset(&f, 0, sizeof(f));
+}
+
+/**
+ * @brief Tell whether every source disagrees with the estimate
+ *
+ * @param source sensor of the measure just rejected
+ * @return true source was rejected REJECT_RUN times in a row and the other sources at least once
+ */
+static bool fusion_step(enum fusion_source source) {
+    if (f.rejects[source] < REJECT_RUN) {
+        return false;
+    }
+    for (int i = 0; i < FUSION_SOURCE_COUNT; i++) {
+        if (f.rejects[i] == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Feed one temperature measure
+ *
+ * @param source sensor the measure comes from
+ * @param temperature temperature * 100
+ * @param now uptime in ms
+ * @return int32_t fused temperature * 100
+ */
+int32_t fusion_update(enum fusion_source source, int32_t temperature, int64_t now) {
+    int32_t z = (temperature << Q) - f.bias[source];
+    int32_t y, s, k;
+    int64_t p;
+    int32_t mean;
+
+    if (!f.valid) {
+        f.x = z;
+        f.p = meas_var[source];
+        f.last = now;
+        f.valid = true;
+        f.accepted++;
+        return f.x >> Q;
+    }
+
+    // Predict: temperature follows a random walk, the variance saturates
+    // when no measure comes in for hours
+    p = f.p + ((int64_t) PROCESS_VAR * (now - f.last)) / 1000;
+    f.p = p > MAX_VAR ? MAX_VAR : (int32_t) p;
+    f.last = now;
+
+    // Gate
+    y = z - f.x;
+    s = f.p + meas_var[source];
+    if ((int64_t) y * y > ((int64_t) FUSION_GATE * FUSION_GATE * s) << Q) {
+        f.rejected++;
+        f.rejects[source]++;
+        f.run = 0;
+        if (fusion_step(source)) {
+            // All the sensors moved together, restart from the measure
+            f.x = z;
+            f.p = meas_var[source];
+            memset(f.rejects, 0, sizeof(f.rejects));
+            f.steps++;
+        }
+        return f.x >> Q;
+    }
+    f.rejects[source] = 0;
+
+    // Update, gain in Q16
+    k = (int32_t) (((int64_t) f.p << 16) / s);
+    f.x += (int32_t) (((int64_t) k * y) >> 16);
+    f.p = (int32_t) (((int64_t) (65536 - k) * f.p) >> 16);
+    f.accepted++;
+
+    // Bias: pull the source toward the estimate, keep the biases zero mean
+    f.bias[source] += y / BIAS_RATE;
+    mean = 0;
+    for (int i = 0; i < FUSION_SOURCE_COUNT; i++) {
+        mean += f.bias[i];
+    }
+    mean /= FUSION_SOURCE_COUNT;
+    for (int i = 0; i < FUSION_SOURCE_COUNT; i++) {
+        f.bias[i] -= mean;
+    }
+
+    if ((int64_t) y * y <= (int64_t) s << Q) {
+        f.run++;
+    } else {
+        f.run = 0;
+    }
+    return f.x >> Q;
+}
+
+/**
+ * @brief Tell whether the estimate is settled
+ *
+ * @return true the last STABLE_RUN measures were within one sigma and the variance is low
+ */
+bool fusion_stable(void) {
+    return f.valid && f.run >= STABLE_RUN && f.p <= STABLE_VAR;
+}
+
+/**
+ * @brief Get the fused estimate and its statistics
+ *
+ * @param stats pointer to returned statistics
+ */
+void fusion_get(fusion_stats_t *stats) {
+    stats->temperature = f.x >> Q;
+    stats->variance = f.p >> Q;
+    for (int i = 0; i < FUSION_SOURCE_COUNT; i++) {
+        stats->bias[i] = f.bias[i] >> Q;
+    }
+    stats->accepted = f.accepted;
+    stats->rejected = f.rejected;
+    stats->steps = f.steps;
+}
@@ -0,0 +1,346 @@
+/** @file
+ *  @brief BTHome gateway code
+ *
+ *  Observer role for the dongle: a continuous passive scan, the BTHome
+ *  service data is located in the advertising report in place and only
+ *  the packet id is decoded; the objects are copied once, into the frame
+ *  ring buffer.
+ *  Repeated packets are filtered with a fixed-size open addressing table
+ *  of the nodes, so the scan callback does a bounded amount of work per
+ *  report. Frames are queued in a ring buffer drained by the CDC-ACM
+ *  interrupt; when it is full the frame is dropped and counted, the scan
+ *  is never slowed down.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/hci.h>
+#include <drivers/uart.h>
+#include <kernel.h>
+#include <string.h>
+#include <sys/crc.h>
+#include <sys/printk.h>
+#include <sys/ring_buffer.h>
+#include <usb/usb_device.h>
+
+#include <bthome.h>
+#include <gateway.h>
+
+#ifdef CONFIG_APP_GATEWAY
+
+#define NODE_PROBES 8     // linear probing window
+#define SCAN_PARAM  BT_LE_SCAN_PARAM(BT_LE_SCAN_TYPE_PASSIVE, BT_LE_SCAN_OPT_NONE, BT_GAP_SCAN_FAST_INTERVAL, BT_GAP_SCAN_FAST_INTERVAL)
+
+BUILD_ASSERT((CONFIG_APP_GATEWAY_NODES & (CONFIG_APP_GATEWAY_NODES - 1)) == 0, "APP_GATEWAY_NODES must be a power of 2");
+
+/**
+ * @struct gateway_node
+ * @brief Last packet of one advertiser.
+ * */
+struct gateway_node {
+    bt_addr_le_t addr;
+    bool used;
+    uint8_t packet_id;
+    bool has_packet_id;
+    uint16_t payload_crc;   // without packet id
+    uint32_t seen;          // k_uptime_get_32()
+};
+
+static struct gateway_node nodes[CONFIG_APP_GATEWAY_NODES];
+static uint16_t nb_nodes;
+
+static const struct device *cdc;
+static uint8_t ring_data[CONFIG_APP_GATEWAY_RING_SIZE];
+static struct ring_buf ring;
+static struct k_spinlock ring_lock;
+
+static struct k_work_delayable stats_work;
+static gateway_stats_t stats;
+static uint32_t nb_adv;
+static uint32_t nb_bthome;
+
+/**
+ * @brief Hash of an address, FNV-1a
+ *
+ * @param addr advertiser address
+ * @return uint32_t table index
+ */
+static uint32_t node_hash(const bt_addr_le_t *addr) {
+    uint32_t hash = 2166136261u ^ addr->type;
+
+    for (int i = 0; i < sizeof(addr->a.val); i++) {
+        hash = (hash ^ addr->a.val[i]) * 16777619u;
+    }
+    return hash & (CONFIG_APP_GATEWAY_NODES - 1);
+}
+
+/**
+ * @brief Find or insert a node
+ *
+ * Looks at NODE_PROBES slots at most. When they are all taken by other
+ * nodes, the least recently seen one is replaced.
+ *
+ * @param addr advertiser address
+ * @param created set to true when the node was not in the table
+ * @return struct gateway_node* table entry
+ */
+static struct gateway_node *node_get(const bt_addr_le_t *addr, bool *created) {
+    uint32_t index = node_hash(addr);
+    struct gateway_node *oldest = NULL;
+    bool evict = true;
+
+    for (int i = 0; i < NODE_PROBES; i++) {
+        struct gateway_node *node = &nodes[(index + i) & (CONFIG_APP_GATEWAY_NODES - 1)];
+
+        if (!node->used) {
+            node->used = true;
+            nb_nodes++;
+            oldest = node;
+            evict = false;
+            break;
+        }
+        if (bt_addr_le_cmp(&node->addr, addr) == 0) {
+            *created = false;
+            return node;
+        }
+        if (oldest == NULL || (int32_t) (node->seen - oldest->seen) < 0) {
+            oldest = node;
+        }
+    }
+    if (evict) {
+        stats.evicted++;
+    }
+    bt_addr_le_copy(&oldest->addr, addr);
+    *created = true;
+    return oldest;
+}
+
+/**
+ * @brief Tell whether this payload was already forwarded for this node
+ *
+ * With a packet id object the packet id identifies the payload, otherwise
+ * a CRC of the whole service data does, including for the encrypted
+ * payloads and the unknown objects that cannot be parsed.
+ *
+ * @param addr advertiser address
+ * @param data BTHome service data
+ * @param len size of data
+ * @return int 1 when repeated, 0 when new, negative error code when malformed or not BTHome v2
+ */
+static int node_repeated(const bt_addr_le_t *addr, const uint8_t *data, uint8_t len) {
+    bthome_reader_t reader;
+    bthome_object_t object;
+    struct gateway_node *node;
+    bool created;
+    bool has_packet_id = false;
+    uint8_t packet_id = 0;
+    uint16_t crc;
+    int err;
+
+    // The packet id is the first object when present. Encrypted payloads
+    // and payloads starting with an object this decoder does not know are
+    // forwarded as is, the CRC identifies them.
+    err = bthome_parse_begin(&reader, data, len);
+    if (err >= 0) {
+        err = bthome_parse_next(&reader, &object);
+    }
+    if (err < 0 && err != -ENOTSUP) {
+        return err;
+    }
+    if (err == 1 && object.id == BTHOME_PACKET_ID) {
+        has_packet_id = true;
+        packet_id = object.value[0];
+    }
+    crc = crc16_ccitt(0xffff, data, len);
+
+    node = node_get(addr, &created);
+    node->seen = k_uptime_get_32();
+    if (!created && node->has_packet_id == has_packet_id && (has_packet_id ? node->packet_id == packet_id : node->payload_crc == crc)) {
+        return 1;
+    }
+    node->has_packet_id = has_packet_id;
+    node->packet_id = packet_id;
+    node->payload_crc = crc;
+    return 0;
+}
+
+/**
+ * @brief Queue one frame for the CDC-ACM interrupt
+ *
+ * @param type GATEWAY_FRAME_*
+ * @param head first part of the payload
+ * @param head_len size of head
+ * @param body second part of the payload
+ * @param body_len size of body
+ * @return int 0, -ENOMEM when the frame was dropped
+ */
+static int frame_put(uint8_t type, const uint8_t *head, uint8_t head_len, const uint8_t *body, uint8_t body_len) {
+    uint8_t hdr[3] = {GATEWAY_SYNC, type, head_len + body_len};
+    uint8_t crc = crc8_ccitt(0xff, &hdr[1], 2);
+    k_spinlock_key_t key;
+    uint32_t used;
+
+    crc = crc8_ccitt(crc, head, head_len);
+    crc = crc8_ccitt(crc, body, body_len);
+
+    key = k_spin_lock(&ring_lock);
+    if (ring_buf_space_get(&ring) < sizeof(hdr) + head_len + body_len + 1) {
+        stats.dropped++;
+        k_spin_unlock(&ring_lock, key);
+        return -ENOMEM;
+    }
+    ring_buf_put(&ring, hdr, sizeof(hdr));
+    ring_buf_put(&ring, head, head_len);
+    ring_buf_put(&ring, body, body_len);
+    ring_buf_put(&ring, &crc, 1);
+    used = ring_buf_capacity_get(&ring) - ring_buf_space_get(&ring);
+    stats.max_fill = MAX(stats.max_fill, used);
+    k_spin_unlock(&ring_lock, key);
+
+    uart_irq_tx_enable(cdc);
+    return 0;
+}
+
+/**
+ * @brief Locate the BTHome service data in an advertising report
+ *
+ * @param ad advertising data
+ * @param len set to the service data size
+ * @return const uint8_t* service data starting with the UUID, NULL when absent
+ */
+static const uint8_t *find_bthome(const struct net_buf_simple *ad, uint8_t *len) {
+    const uint8_t *data = ad->data;
+    uint16_t remaining = ad->len;
+
+    while (remaining > 1) {
+        uint8_t field_len = data[0];
+
+        if (field_len == 0 || field_len >= remaining) {
+            return NULL;
+        }
+        if (data[1] == BT_DATA_SVC_DATA16 && field_len >= 3 && (data[2] | (data[3] << 8)) == BTHOME_SERVICE_UUID) {
+            *len = field_len - 1;
+            return &data[2];
+        }
+        data += field_len + 1;
+        remaining -= field_len + 1;
+    }
+    return NULL;
+}
+
+/**
+ * @brief Advertising report, runs in the Bluetooth receive thread
+ */
+static void scan_cb(const bt_addr_le_t *addr, int8_t rssi, uint8_t adv_type, struct net_buf_simple *ad) {
+    uint8_t head[8];
+    const uint8_t *data;
+    uint8_t len;
+    int repeated;
+
+    nb_adv++;
+    data = find_bthome(ad, &len);
+    if (data == NULL) {
+        return;
+    }
+    repeated = node_repeated(addr, data, len);
+    if (repeated < 0) {
+        stats.invalid++;
+        return;
+    }
+    if (repeated) {
+        stats.duplicates++;
+        return;
+    }
+    head[0] = addr->type;
+    memcpy(&head[1], addr->a.val, sizeof(addr->a.val));
+    head[7] = rssi;
+    // the UUID is implied by the frame type
+    if (frame_put(GATEWAY_FRAME_REPORT, head, sizeof(head), data + 2, len - 2) == 0) {
+        nb_bthome++;
+    }
+}
+
+/**
+ * @brief Drain the ring buffer into the CDC-ACM FIFO
+ */
+static void cdc_isr(const struct device *dev, void *user_data) {
+    while (uart_irq_update(dev) && uart_irq_is_pending(dev)) {
+        if (uart_irq_rx_ready(dev)) {
+            uint8_t discard[16];
+
+            uart_fifo_read(dev, discard, sizeof(discard));   // the gateway takes no command
+        }
+        if (uart_irq_tx_ready(dev)) {
+            k_spinlock_key_t key = k_spin_lock(&ring_lock);
+            uint8_t *chunk;
+            uint32_t len = ring_buf_get_claim(&ring, &chunk, ring_buf_capacity_get(&ring));
+
+            if (len == 0) {
+                uart_irq_tx_disable(dev);
+            } else {
+                ring_buf_get_finish(&ring, uart_fifo_fill(dev, chunk, len));
+            }
+            k_spin_unlock(&ring_lock, key);
+        }
+    }
+}
+
+static void stats_report(struct k_work *work) {
+    gateway_stats_t out;
+
+    stats.adv_rate = nb_adv;
+    stats.bthome_rate = nb_bthome;
+    stats.nodes = nb_nodes;
+    nb_adv = 0;
+    nb_bthome = 0;
+    out = stats;
+    frame_put(GATEWAY_FRAME_STATS, (const uint8_t *) &out, sizeof(out), NULL, 0);
+    k_work_schedule(&stats_work, K_SECONDS(1));
+}
+
+/**
+ * @brief Start USB, Bluetooth and the continuous scan
+ *
+ * @return int error code
+ */
+int gateway_start(void) {
+    int err;
+
+    printk("Starting BTHome gateway\n");
+    ring_buf_init(&ring, sizeof(ring_data), ring_data);
+
+    cdc = device_get_binding("CDC_ACM_0");
+    if (cdc == NULL) {
+        printk("CDC ACM device not found\n");
+        return -ENODEV;
+    }
+    err = usb_enable(NULL);
+    if (err) {
+        printk("USB enable failed (err %d)\n", err);
+        return err;
+    }
+    uart_irq_callback_set(cdc, cdc_isr);
+    uart_irq_rx_enable(cdc);
+
+    err = bt_enable(NULL);
+    if (err) {
+        printk("Bluetooth init failed (err %d)\n", err);
+        return err;
+    }
+    err = bt_le_scan_start(SCAN_PARAM, scan_cb);
+    if (err) {
+        printk("Scanning failed to start (err %d)\n", err);
+        return err;
+    }
+
+    k_work_init_delayable(&stats_work, stats_report);
+    k_work_schedule(&stats_work, K_SECONDS(1));
+    return 0;
+}
+
+#endif
@@ -1,4 +1,3 @@
-
 /** @file
  *  @brief I2C Service code
  */
@@ -19,43 +18,136 @@
 #include <sys/byteorder.h>
 #include <sys/util.h>
 
+#include <am2320.h>
+#include <bmp180.h>
+#include <i2c.h>
+
+#define ADDR_FIRST 0x08   // 0x00-0x07 and 0x78-0x7F are reserved
+#define ADDR_LAST  0x77
+
+#define SCAN_STACK 768
+#define SCAN_PRIO  K_PRIO_PREEMPT(4)
+
+// Addresses of the drivers in this firmware, probed first
+static const uint8_t known_addr[] = {AM2320_R_ADDRESS, BMP180_R_ADDRESS, 0x76 /* BMP280 SDO low */};
+
+/**
+ * @brief Check one address with a read-style transaction
+ *
+ * Nothing is ever written to an unknown device. The AM2320 does not
+ * acknowledge while asleep but wakes up, so its address gets a second try.
+ *
+ * @param dev bus
+ * @param addr 7 bit address
+ * @return true the address was acknowledged
+ */
+static bool i2c_probe(const struct device *dev, uint8_t addr) {
+    uint8_t dummy;
+
+    if (i2c_read(dev, &dummy, 1, addr) == 0) {
+        return true;
+    }
+    if (addr == AM2320_R_ADDRESS) {
+        k_busy_wait(800);   // wake-up time
+        return i2c_read(dev, &dummy, 1, addr) == 0;
+    }
+    return false;
+}
+
 /**
  * @brief Scan I2C bus
  *
+ * The bus runs in fast mode during the scan, then its configuration is
+ * restored, or set to standard mode when the driver cannot report it.
+ *
+ * @param bus bus label
+ * @param flags I2C_SCAN_KNOWN_ONLY
+ * @param result answering addresses and scan time
+ * @return int number of devices found, negative error code
  */
-void i2c_scan(void) {
+int i2c_scan(const char *bus, uint8_t flags, i2c_scan_result_t *result) {
     const struct device *i2c_dev;
-    int error;
-    int cnt = 0;
+    uint32_t config;
+    uint32_t start = k_cycle_get_32();
 
-    i2c_dev = device_get_binding("I2C_0");
+    memset(result, 0, sizeof(*result));
+    result->bus = bus;
+    i2c_dev = device_get_binding(bus);
     if (!i2c_dev) {
-        printk("Binding failed.");
-        return;
-    }
-
-    /* Demonstration of runtime configuration */
-    i2c_configure(i2c_dev, I2C_SPEED_SET(I2C_SPEED_STANDARD));
-    printk("Value of NRF_TWIM2->PSEL.SCL : %d \n", NRF_TWIM0->PSEL.SCL);
-    printk("Value of NRF_TWIM2->PSEL.SDA : %d \n", NRF_TWIM0->PSEL.SDA);
-    printk("Value of NRF_TWIM2->FREQUENCY: %d \n", NRF_TWIM0->FREQUENCY);
-    printk("26738688 -> 100k\n");
-
-    for (uint8_t i = 4; i <= 0x7F; i++) {
-        struct i2c_msg msgs[1];
-        uint8_t dst = 1;
-
-        msgs[0].buf = &dst;
-        msgs[0].len = 1U;
-        msgs[0].flags = I2C_MSG_WRITE | I2C_MSG_STOP;
-
-        error = i2c_transfer(i2c_dev, &msgs[0], 1, i);
-        if (error == 0) {
-            printk("0x%2x FOUND\n", i);
-            cnt++;
-        } else {
-            // printk("error %d \n", error);
+        return -ENODEV;
+    }
+
+    // Drivers without get_config (-ENOSYS) are put back in standard mode
+    if (i2c_get_config(i2c_dev, &config) != 0) {
+        config = I2C_SPEED_SET(I2C_SPEED_STANDARD) | I2C_MODE_MASTER;
+    }
+    i2c_configure(i2c_dev, I2C_SPEED_SET(I2C_SPEED_FAST) | I2C_MODE_MASTER);
+
+    for (int i = 0; i < ARRAY_SIZE(known_addr); i++) {
+        if (i2c_probe(i2c_dev, known_addr[i])) {
+            result->map[known_addr[i] / 8] |= BIT(known_addr[i] % 8);
+            result->count++;
         }
     }
-    printk(" -- %d devices \n", cnt);
+    if (!(flags & I2C_SCAN_KNOWN_ONLY)) {
+        for (uint8_t addr = ADDR_FIRST; addr <= ADDR_LAST; addr++) {
+            bool known = false;
+
+            for (int i = 0; i < ARRAY_SIZE(known_addr); i++) {
+                known |= known_addr[i] == addr;
+            }
+            if (!known && i2c_probe(i2c_dev, addr)) {
+                result->map[addr / 8] |= BIT(addr % 8);
+                result->count++;
+            }
+        }
+    }
+
+    i2c_configure(i2c_dev, config);
+    result->duration_us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+    return result->count;
+}
+
+#ifdef CONFIG_APP_I2C_SCAN_PARALLEL
+static K_THREAD_STACK_DEFINE(scan_stack, SCAN_STACK);
+static struct k_thread scan_thread;
+
+static void i2c_scan_entry(void *bus, void *flags, void *result) {
+    i2c_scan(bus, (uint8_t) (uintptr_t) flags, result);
+}
+#endif
+
+/**
+ * @brief Scan several buses
+ *
+ * With CONFIG_APP_I2C_SCAN_PARALLEL the second bus is scanned by a helper
+ * thread while the calling thread scans the first one, each TWI
+ * controller working on its own.
+ *
+ * @param bus bus labels
+ * @param nb_bus number of buses
+ * @param flags I2C_SCAN_KNOWN_ONLY
+ * @param result one result per bus
+ * @return int total number of devices found
+ */
+int i2c_scan_buses(const char *const *bus, int nb_bus, uint8_t flags, i2c_scan_result_t *result) {
+    int total = 0;
+    int i = 0;
+
+#ifdef CONFIG_APP_I2C_SCAN_PARALLEL
+    if (nb_bus >= 2) {
+        k_thread_create(&scan_thread, scan_stack, K_THREAD_STACK_SIZEOF(scan_stack), i2c_scan_entry, (void *) bus[1], (void *) (uintptr_t) flags,
+                        &result[1], SCAN_PRIO, 0, K_NO_WAIT);
+        i2c_scan(bus[0], flags, &result[0]);
+        k_thread_join(&scan_thread, K_FOREVER);
+        i = 2;
+    }
+#endif
+    for (; i < nb_bus; i++) {
+        i2c_scan(bus[i], flags, &result[i]);
+    }
+    for (i = 0; i < nb_bus; i++) {
+        total += result[i].count;
+    }
+    return total;
 }
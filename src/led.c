@@ -41,7 +41,7 @@ void led_update(int nb) {
     }
 
     led_state[nb] = !led_state[nb];
-    LOG_INF("Turn %s LED", led_state[nb] ? "on" : "off");
+    LOG_DBG("Turn %s LED", led_state[nb] ? "on" : "off");
     gpio_pin_set(led[nb].port, led[nb].pin, led_state[nb]);
 }
 
@@ -57,7 +57,7 @@ void led_set(int nb, bool value) {
     }
 
     led_state[nb] = value;
-    LOG_INF("Turn %s LED", led_state[nb] ? "on" : "off");
+    LOG_DBG("Turn %s LED", led_state[nb] ? "on" : "off");
     gpio_pin_set(led[nb].port, led[nb].pin, led_state[nb]);
 }
 
@@ -0,0 +1,312 @@
+/** @file
+ *  @brief LED status pattern code
+ *
+ *  Patterns are static tables of 50 ms slots, each with a brightness for
+ *  the LED of the pattern, followed by an off time. With the PWM engine a
+ *  pattern is converted once into a PWM sequence: each slot is ten 5 ms
+ *  PWM periods and the off time is the sequence end delay, so the PWM
+ *  plays and loops it from RAM by EasyDMA without interrupts. Starting or
+ *  stopping a pattern is the only CPU work. The PWM peripheral needs the
+ *  16 MHz clock while it plays, about 0.2 mA, which is why only error
+ *  states loop and the acquiring flash is played once.
+ *
+ *  The timer engine (no PWM, native_posix) walks the same tables from a
+ *  k_timer with one wake-up per level change and no dimming.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <drivers/gpio.h>
+#include <kernel.h>
+#include <sys/atomic.h>
+
+#ifdef CONFIG_APP_LED_PATTERN_PWM
+#include <nrfx_pwm.h>
+#endif
+
+#include <led_pattern.h>
+
+#ifdef CONFIG_APP_LED_PATTERN
+
+#define SLOT_MS    50
+#define MAX_SLOTS  10
+#define NB_LED     3
+
+/**
+ * @struct led_pattern_def
+ * @brief Static description of a pattern.
+ * */
+struct led_pattern_def {
+    uint8_t led;                  // led0..led2 alias
+    bool loop;                    // false: played once
+    uint8_t slots;
+    uint8_t level[MAX_SLOTS];     // brightness of each slot, %
+    uint16_t off_ms;              // off time after the slots
+};
+
+static const struct led_pattern_def patterns[LED_PATTERN_COUNT] = {
+    [LED_PATTERN_ACQUIRING] = {.led = 2, .loop = false, .slots = 1, .level = {20}},
+    [LED_PATTERN_LOW_BATTERY] = {.led = 0, .loop = true, .slots = 3, .level = {100, 0, 100}, .off_ms = 4850},
+    [LED_PATTERN_ERROR] = {.led = 0, .loop = true, .slots = 10, .level = {100, 100, 100, 100, 100}},
+};
+
+static struct k_spinlock lock;
+static atomic_t active;    // bit per looping pattern
+static int playing = -1;   // pattern on the LEDs, -1 when none
+static int64_t playing_since;
+static uint32_t wakeups;
+static uint64_t on_ms;
+
+#ifdef CONFIG_APP_LED_PATTERN_PWM
+
+#define PWM_TOP          625   // 125 kHz / 625 = 5 ms period
+#define PWM_PERIOD_MS    5
+#define PWM_ACTIVE_HIGH  0x8000   // falling edge first: output high for the duty cycle
+#define LED_PSEL(n)      NRF_GPIO_PIN_MAP(DT_PROP(DT_GPIO_CTLR(DT_ALIAS(n), gpios), port), DT_GPIO_PIN(DT_ALIAS(n), gpios))
+#define LED_ACTIVE_LOW(n) (DT_GPIO_FLAGS(DT_ALIAS(n), gpios) & GPIO_ACTIVE_LOW)
+
+static const nrfx_pwm_t pwm = NRFX_PWM_INSTANCE(0);
+static nrf_pwm_values_individual_t values[LED_PATTERN_COUNT][MAX_SLOTS];   // EasyDMA reads RAM only
+static nrf_pwm_sequence_t sequences[LED_PATTERN_COUNT];
+
+static uint16_t *pwm_channel(nrf_pwm_values_individual_t *value, uint8_t led) {
+    switch (led) {
+    case 0:
+        return &value->channel_0;
+    case 1:
+        return &value->channel_1;
+    default:
+        return &value->channel_2;
+    }
+}
+
+static int engine_init(void) {
+    const bool active_low[NB_LED] = {LED_ACTIVE_LOW(led0), LED_ACTIVE_LOW(led1), LED_ACTIVE_LOW(led2)};
+    const nrfx_pwm_config_t config = {
+        .output_pins = {LED_PSEL(led0) | (active_low[0] ? NRFX_PWM_PIN_INVERTED : 0), LED_PSEL(led1) | (active_low[1] ? NRFX_PWM_PIN_INVERTED : 0),
+                        LED_PSEL(led2) | (active_low[2] ? NRFX_PWM_PIN_INVERTED : 0), NRFX_PWM_PIN_NOT_USED},
+        .irq_priority = NRFX_PWM_DEFAULT_CONFIG_IRQ_PRIORITY,
+        .base_clock = NRF_PWM_CLK_125kHz,
+        .count_mode = NRF_PWM_MODE_UP,
+        .top_value = PWM_TOP,
+        .load_mode = NRF_PWM_LOAD_INDIVIDUAL,
+        .step_mode = NRF_PWM_STEP_AUTO,
+    };
+
+    for (int p = 0; p < LED_PATTERN_COUNT; p++) {
+        const struct led_pattern_def *def = &patterns[p];
+
+        for (int s = 0; s < def->slots; s++) {
+            for (int led = 0; led < NB_LED; led++) {
+                uint16_t duty = (led == def->led) ? def->level[s] * PWM_TOP / 100 : 0;
+
+                *pwm_channel(&values[p][s], led) = duty | (active_low[led] ? 0 : PWM_ACTIVE_HIGH);
+            }
+        }
+        sequences[p] = (nrf_pwm_sequence_t){
+            .values.p_individual = values[p],
+            .length = def->slots * NRF_PWM_CHANNEL_COUNT,
+            .repeats = SLOT_MS / PWM_PERIOD_MS - 1,
+            .end_delay = def->off_ms / PWM_PERIOD_MS,
+        };
+    }
+    // No handler: the PWM never interrupts the CPU
+    return nrfx_pwm_init(&pwm, &config, NULL, NULL) == NRFX_SUCCESS ? 0 : -EBUSY;
+}
+
+static void engine_play(int p) {
+    nrfx_pwm_simple_playback(&pwm, &sequences[p], 1, patterns[p].loop ? NRFX_PWM_FLAG_LOOP : NRFX_PWM_FLAG_STOP);
+}
+
+static void engine_stop(void) {
+    nrfx_pwm_stop(&pwm, false);
+}
+
+#else   // CONFIG_APP_LED_PATTERN_TIMER
+
+static const struct gpio_dt_spec leds[NB_LED] = {
+    GPIO_DT_SPEC_GET(DT_ALIAS(led0), gpios),
+    GPIO_DT_SPEC_GET(DT_ALIAS(led1), gpios),
+    GPIO_DT_SPEC_GET(DT_ALIAS(led2), gpios),
+};
+static struct k_timer slot_timer;
+static int timer_pattern = -1;   // pattern walked by the timer, one-shot included
+static uint8_t slot;
+
+/**
+ * @brief Apply the current slot and program the next level change
+ *
+ * Called with lock held.
+ */
+static void engine_advance(void) {
+    const struct led_pattern_def *def;
+    uint32_t ms = 0;
+    bool on;
+
+    if (timer_pattern < 0) {
+        return;
+    }
+    def = &patterns[timer_pattern];
+    if (slot >= def->slots) {
+        gpio_pin_set_dt(&leds[def->led], 0);
+        if (!def->loop) {
+            timer_pattern = -1;
+            return;
+        }
+        slot = 0;
+        k_timer_start(&slot_timer, K_MSEC(MAX(def->off_ms, 1)), K_NO_WAIT);
+        return;
+    }
+    on = def->level[slot] != 0;
+    gpio_pin_set_dt(&leds[def->led], on);
+    // merge the slots at the same level
+    do {
+        ms += SLOT_MS;
+        slot++;
+    } while (slot < def->slots && (def->level[slot] != 0) == on);
+    k_timer_start(&slot_timer, K_MSEC(ms), K_NO_WAIT);
+}
+
+static void engine_step(struct k_timer *timer) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    wakeups++;
+    engine_advance();
+    k_spin_unlock(&lock, key);
+}
+
+static int engine_init(void) {
+    k_timer_init(&slot_timer, engine_step, NULL);
+    return 0;
+}
+
+static void engine_play(int p) {
+    timer_pattern = p;
+    slot = 0;
+    engine_advance();
+}
+
+static void engine_stop(void) {
+    k_timer_stop(&slot_timer);
+    timer_pattern = -1;
+    for (int led = 0; led < NB_LED; led++) {
+        gpio_pin_set_dt(&leds[led], 0);
+    }
+}
+
+#endif
+
+/**
+ * @brief LED on-time of one play of a pattern
+ *
+ * @param def pattern
+ * @param period_ms set to the pattern period
+ * @return uint32_t on-time in ms, weighted by the brightness
+ */
+static uint32_t pattern_on_ms(const struct led_pattern_def *def, uint32_t *period_ms) {
+    uint32_t on = 0;
+
+    for (int s = 0; s < def->slots; s++) {
+        on += def->level[s] * SLOT_MS / 100;
+    }
+    *period_ms = def->slots * SLOT_MS + def->off_ms;
+    return on;
+}
+
+/**
+ * @brief On-time of the looping pattern since it started, called with lock held
+ *
+ * @param now uptime
+ * @return uint64_t on-time in ms
+ */
+static uint64_t playing_on_ms(int64_t now) {
+    uint32_t period;
+    uint32_t on;
+
+    if (playing < 0 || !patterns[playing].loop) {
+        return 0;
+    }
+    on = pattern_on_ms(&patterns[playing], &period);
+    return (uint64_t) (now - playing_since) * on / period;
+}
+
+/**
+ * @brief Play the highest priority looping pattern, called with lock held
+ */
+static void led_pattern_update(void) {
+    int64_t now = k_uptime_get();
+    atomic_val_t mask = atomic_get(&active);
+    int next = mask ? 31 - __builtin_clz(mask) : -1;
+
+    if (next == playing) {
+        return;
+    }
+    on_ms += playing_on_ms(now);
+    wakeups++;
+    playing = next;
+    playing_since = now;
+    if (next < 0) {
+        engine_stop();
+    } else {
+        engine_play(next);
+    }
+}
+
+/**
+ * @brief Start or stop a pattern
+ *
+ * A looping pattern plays until cleared. A one-shot pattern plays once
+ * when set, unless a looping pattern is on the LEDs.
+ *
+ * @param pattern enum led_pattern
+ * @param set true to start
+ */
+void led_pattern_set(enum led_pattern pattern, bool set) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    if (patterns[pattern].loop) {
+        if (set) {
+            atomic_set_bit(&active, pattern);
+        } else {
+            atomic_clear_bit(&active, pattern);
+        }
+        led_pattern_update();
+    } else if (set && playing < 0) {
+        uint32_t period;
+
+        on_ms += pattern_on_ms(&patterns[pattern], &period);
+        wakeups++;
+        engine_play(pattern);
+    }
+    k_spin_unlock(&lock, key);
+}
+
+/**
+ * @brief Get the engine cost since boot
+ *
+ * @param stats wake-ups and on-time
+ */
+void led_pattern_get(led_pattern_stats_t *stats) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    int64_t now = k_uptime_get();
+
+    stats->wakeups = wakeups;
+    stats->on_ms = (uint32_t) (on_ms + playing_on_ms(now));
+    stats->uptime_ms = (uint32_t) now;
+    k_spin_unlock(&lock, key);
+}
+
+/**
+ * @brief Prepare the pattern engine
+ *
+ * @return int error code
+ */
+int led_pattern_init(void) {
+    return engine_init();
+}
+
+#endif
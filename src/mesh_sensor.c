@@ -0,0 +1,667 @@
+/** @file
+ *  @brief Bluetooth Mesh sensor server code
+ *
+ *  Sensor Server and Sensor Setup Server models (Mesh Model specification,
+ *  chapter 4) on top of the access layer, for the ambient temperature,
+ *  humidity and air pressure properties. The encoder hands every batch to
+ *  mesh_sensor_update(), which keeps the latest raw values, switches the
+ *  publication to the fast cadence while a value is in its fast cadence
+ *  range and publishes right away when a value moved by its status trigger
+ *  delta, no more often than the status minimum interval.
+ *
+ *  A mains powered node relays and acts as a friend; a battery node is a
+ *  low power node that only wakes up to publish and to poll its friend.
+ *  The sink role is a Sensor Client that logs the statuses it receives, for
+ *  the BabbleSim scenario (zephyr/bsim).
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <bluetooth/bluetooth.h>
+#include <bluetooth/mesh.h>
+#include <kernel.h>
+#include <settings/settings.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/byteorder.h>
+#include <sys/printk.h>
+#include <sys/util.h>
+
+#include <mesh_sensor.h>
+#include <pipeline.h>
+
+#ifdef CONFIG_APP_MESH
+
+#define OP_SENSOR_DESCRIPTOR_GET    BT_MESH_MODEL_OP_2(0x82, 0x30)
+#define OP_SENSOR_DESCRIPTOR_STATUS BT_MESH_MODEL_OP_1(0x51)
+#define OP_SENSOR_GET               BT_MESH_MODEL_OP_2(0x82, 0x31)
+#define OP_SENSOR_STATUS            BT_MESH_MODEL_OP_1(0x52)
+#define OP_SENSOR_CADENCE_GET       BT_MESH_MODEL_OP_2(0x82, 0x34)
+#define OP_SENSOR_CADENCE_SET       BT_MESH_MODEL_OP_1(0x55)
+#define OP_SENSOR_CADENCE_SET_UNACK BT_MESH_MODEL_OP_1(0x56)
+#define OP_SENSOR_CADENCE_STATUS    BT_MESH_MODEL_OP_1(0x57)
+
+#define NB_CHANNEL         3
+#define DESCRIPTOR_LEN     8
+#define STATUS_MAX         (NB_CHANNEL * 2 + 1 + 2 + 4)   // format A headers and values
+#define CADENCE_MAX        (2 + 1 + 2 * 4 + 1 + 2 * 4)
+#define DIVISOR_MAX        15
+#define MIN_INTERVAL_MAX   26
+#define SAMPLING_INSTANT   0x01
+#define NET_IDX            0
+#define APP_IDX            0
+#define COMPANY_ID         0x05F1   // Linux Foundation
+#define FIRST_SENSOR_MODEL 3        // after the configuration and health models
+
+/**
+ * @brief Cadence and latest value of one property
+ */
+struct mesh_channel {
+    uint16_t property;
+    uint8_t size;              // raw value size
+    bool is_signed;
+    uint32_t unknown;          // raw value meaning "value is not known"
+    // Sensor Cadence state
+    uint8_t divisor;           // fast cadence period divisor, 2^n
+    bool percent;              // trigger deltas in 0.01 % of the published value
+    uint32_t delta_down;
+    uint32_t delta_up;
+    uint8_t min_interval;      // status min interval, 2^n ms
+    int32_t fast_low;
+    int32_t fast_high;
+    // values
+    int32_t value;             // latest raw value
+    int32_t published;         // raw value of the last status
+    int64_t published_at;      // uptime of the last status, 0 before the first one
+};
+
+static struct mesh_channel channel[NB_CHANNEL] = {
+    {.property = MESH_PROP_PRESENT_AMB_TEMP, .size = 1, .is_signed = true, .unknown = 0x7F,
+     .delta_down = 1, .delta_up = 1, .min_interval = 10, .fast_low = 1, .fast_high = 0},   // 0.5 degC, 1 s
+    {.property = MESH_PROP_PRESENT_AMB_HUMID, .size = 2, .unknown = 0xFFFF,
+     .delta_down = 200, .delta_up = 200, .min_interval = 10, .fast_low = 1, .fast_high = 0},   // 2 %
+    {.property = MESH_PROP_AIR_PRESSURE, .size = 4, .unknown = 0,
+     .delta_down = 500, .delta_up = 500, .min_interval = 10, .fast_low = 1, .fast_high = 0},   // 50 Pa
+};
+
+static struct k_spinlock lock;
+static mesh_sensor_stats_t stats;
+static struct k_work publish_work;
+static uint8_t dev_uuid[16] = {0xdd, 0xdd};
+
+static int sensor_pub_update(struct bt_mesh_model *model);
+BT_MESH_MODEL_PUB_DEFINE(sensor_pub, sensor_pub_update, BT_MESH_MODEL_BUF_LEN(OP_SENSOR_STATUS, STATUS_MAX));
+
+#ifdef CONFIG_APP_MESH_SELF_PROVISION
+// Bench and simulation keys, a deployment is provisioned over PB-ADV instead
+static const uint8_t net_key[16] = {0x4e, 0x3b, 0x1a, 0x6c, 0x92, 0x07, 0xd5, 0x28, 0xbe, 0x41, 0x7f, 0x0c, 0x63, 0xa9, 0x15, 0xe2};
+static const uint8_t app_key[16] = {0x9d, 0x52, 0xe7, 0x30, 0x0b, 0x84, 0x6f, 0xc1, 0x2a, 0x58, 0xf6, 0x13, 0xbd, 0x47, 0x89, 0x6e};
+static const uint8_t dev_key[16] = {0x21, 0xc8, 0x5e, 0x97, 0x3d, 0x60, 0xfa, 0x04, 0x7b, 0xe9, 0x12, 0xa6, 0x58, 0x3f, 0xd1, 0x8c};
+#endif
+
+/**
+ * @brief Log a status with a timestamp, parsed by zephyr/bsim/mesh_report.py
+ *
+ * @param dir "tx" or "rx"
+ * @param addr source address
+ * @param data status parameters
+ * @param len parameters size
+ */
+static void mesh_log(const char *dir, uint16_t addr, const uint8_t *data, size_t len) {
+#ifdef CONFIG_APP_MESH_LOG
+    char hex[2 * STATUS_MAX + 1];
+
+    bin2hex(data, MIN(len, STATUS_MAX), hex, sizeof(hex));
+    printk("mesh %s %04x %s %llu\n", dir, addr, hex, k_ticks_to_us_floor64(k_uptime_ticks()));
+#endif
+}
+
+/**
+ * @brief Convert a pipeline measure to the raw property value
+ *
+ * @param ch channel
+ * @param value latest value of each pipeline channel
+ * @return int32_t raw value, ch->unknown when the channel is unset (no read yet or failed read)
+ */
+static int32_t mesh_raw(const struct mesh_channel *ch, const int32_t *value) {
+    int32_t v;
+
+    switch (ch->property) {
+    case MESH_PROP_PRESENT_AMB_TEMP:
+#ifdef CONFIG_APP_FUSION
+        v = value[PIPELINE_TEMP_FUSED];
+#else
+        v = value[PIPELINE_TEMP];
+#endif
+        if (v == PIPELINE_UNSET) {
+            return ch->unknown;   // no BMP180 read yet
+        }
+        v = (v >= 0 ? v + 25 : v - 25) / 50;   // 0.01 degC to 0.5 degC, rounded
+        return CLAMP(v, -128, 126);
+    case MESH_PROP_PRESENT_AMB_HUMID:
+        v = value[PIPELINE_HUMIDITY];
+        return v == PIPELINE_UNSET ? (int32_t) ch->unknown : CLAMP(v, 0, 10000);
+    case MESH_PROP_AIR_PRESSURE:
+        v = value[PIPELINE_PRESSURE];
+        return v > 0 ? v * 10 : (int32_t) ch->unknown;   // Pa to 0.1 Pa
+    default:
+        return ch->unknown;
+    }
+}
+
+static void mesh_value_add(struct net_buf_simple *buf, uint8_t size, int32_t value) {
+    switch (size) {
+    case 1:
+        net_buf_simple_add_u8(buf, (uint8_t) value);
+        break;
+    case 2:
+        net_buf_simple_add_le16(buf, (uint16_t) value);
+        break;
+    default:
+        net_buf_simple_add_le32(buf, (uint32_t) value);
+        break;
+    }
+}
+
+/**
+ * @brief Add the marshalled sensor data of a channel, format A
+ *
+ * @param buf message
+ * @param ch channel
+ */
+static void mesh_status_add(struct net_buf_simple *buf, struct mesh_channel *ch) {
+    net_buf_simple_add_le16(buf, (ch->property << 5) | ((ch->size - 1) << 1));
+    mesh_value_add(buf, ch->size, ch->value);
+}
+
+/**
+ * @brief Sensor Status with every property, marks them published
+ *
+ * @param buf message, initialized here
+ */
+static void mesh_status_fill(struct net_buf_simple *buf) {
+    int64_t now = k_uptime_get();
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    bt_mesh_model_msg_init(buf, OP_SENSOR_STATUS);
+    for (int i = 0; i < NB_CHANNEL; i++) {
+        mesh_status_add(buf, &channel[i]);
+        channel[i].published = channel[i].value;
+        channel[i].published_at = now;
+    }
+    k_spin_unlock(&lock, key);
+}
+
+/**
+ * @brief Publication callback, fills the periodic status
+ *
+ * @param model sensor server
+ * @return int 0 to publish
+ */
+static int sensor_pub_update(struct bt_mesh_model *model) {
+    mesh_status_fill(model->pub->msg);
+    stats.periodic++;
+    mesh_log("tx", bt_mesh_model_elem(model)->addr, model->pub->msg->data + 1, model->pub->msg->len - 1);
+    return 0;
+}
+
+/**
+ * @brief Publish now, on a status trigger
+ *
+ * @param work unused
+ */
+static void mesh_publish(struct k_work *work) {
+    struct bt_mesh_model *model = sensor_pub.mod;
+
+    mesh_status_fill(sensor_pub.msg);
+    if (bt_mesh_model_publish(model) == 0) {
+        stats.triggered++;
+        mesh_log("tx", bt_mesh_model_elem(model)->addr, sensor_pub.msg->data + 1, sensor_pub.msg->len - 1);
+    }
+}
+
+#ifndef CONFIG_APP_MESH_ROLE_SINK
+static struct mesh_channel *mesh_channel_find(uint16_t property) {
+    for (int i = 0; i < NB_CHANNEL; i++) {
+        if (channel[i].property == property) {
+            return &channel[i];
+        }
+    }
+    return NULL;
+}
+
+static int32_t mesh_value_pull(struct net_buf_simple *buf, uint8_t size, bool is_signed) {
+    switch (size) {
+    case 1:
+        return is_signed ? (int8_t) net_buf_simple_pull_u8(buf) : net_buf_simple_pull_u8(buf);
+    case 2:
+        return is_signed ? (int16_t) net_buf_simple_pull_le16(buf) : net_buf_simple_pull_le16(buf);
+    default:
+        return (int32_t) net_buf_simple_pull_le32(buf);
+    }
+}
+
+static int sensor_descriptor_get(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf) {
+    BT_MESH_MODEL_BUF_DEFINE(msg, OP_SENSOR_DESCRIPTOR_STATUS, NB_CHANNEL * DESCRIPTOR_LEN);
+    struct mesh_channel *ch = NULL;
+
+    if (buf->len == 2) {
+        uint16_t property = net_buf_simple_pull_le16(buf);
+
+        ch = mesh_channel_find(property);
+        if (ch == NULL) {
+            bt_mesh_model_msg_init(&msg, OP_SENSOR_DESCRIPTOR_STATUS);
+            net_buf_simple_add_le16(&msg, property);
+            return bt_mesh_model_send(model, ctx, &msg, NULL, NULL);
+        }
+    } else if (buf->len != 0) {
+        return -EINVAL;
+    }
+
+    bt_mesh_model_msg_init(&msg, OP_SENSOR_DESCRIPTOR_STATUS);
+    for (int i = 0; i < NB_CHANNEL; i++) {
+        if (ch != NULL && ch != &channel[i]) {
+            continue;
+        }
+        net_buf_simple_add_le16(&msg, channel[i].property);
+        net_buf_simple_add_le24(&msg, 0);   // tolerances unspecified
+        net_buf_simple_add_u8(&msg, SAMPLING_INSTANT);
+        net_buf_simple_add_u8(&msg, 0);     // measurement period not applicable
+        net_buf_simple_add_u8(&msg, 0);     // update interval not applicable
+    }
+    return bt_mesh_model_send(model, ctx, &msg, NULL, NULL);
+}
+
+static int sensor_get(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf) {
+    BT_MESH_MODEL_BUF_DEFINE(msg, OP_SENSOR_STATUS, STATUS_MAX);
+    struct mesh_channel *ch;
+    k_spinlock_key_t key;
+
+    if (buf->len == 0) {
+        mesh_status_fill(&msg);
+    } else if (buf->len == 2) {
+        uint16_t property = net_buf_simple_pull_le16(buf);
+
+        bt_mesh_model_msg_init(&msg, OP_SENSOR_STATUS);
+        ch = mesh_channel_find(property);
+        if (ch == NULL) {
+            net_buf_simple_add_le24(&msg, 0xFF | (property << 8));   // format B, zero length
+        } else {
+            key = k_spin_lock(&lock);
+            mesh_status_add(&msg, ch);
+            k_spin_unlock(&lock, key);
+        }
+    } else {
+        return -EINVAL;
+    }
+    stats.replies++;
+    return bt_mesh_model_send(model, ctx, &msg, NULL, NULL);
+}
+
+/**
+ * @brief Sensor Cadence Status of a property
+ *
+ * @param model sensor setup server
+ * @param ctx destination
+ * @param property property id
+ * @return int error code
+ */
+static int sensor_cadence_send(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, uint16_t property) {
+    BT_MESH_MODEL_BUF_DEFINE(msg, OP_SENSOR_CADENCE_STATUS, CADENCE_MAX);
+    struct mesh_channel *ch = mesh_channel_find(property);
+    k_spinlock_key_t key;
+    uint8_t delta_size;
+
+    bt_mesh_model_msg_init(&msg, OP_SENSOR_CADENCE_STATUS);
+    net_buf_simple_add_le16(&msg, property);
+    if (ch != NULL) {
+        key = k_spin_lock(&lock);
+        delta_size = ch->percent ? 2 : ch->size;
+        net_buf_simple_add_u8(&msg, ch->divisor | (ch->percent << 7));
+        mesh_value_add(&msg, delta_size, ch->delta_down);
+        mesh_value_add(&msg, delta_size, ch->delta_up);
+        net_buf_simple_add_u8(&msg, ch->min_interval);
+        mesh_value_add(&msg, ch->size, ch->fast_low);
+        mesh_value_add(&msg, ch->size, ch->fast_high);
+        k_spin_unlock(&lock, key);
+    }
+    return bt_mesh_model_send(model, ctx, &msg, NULL, NULL);
+}
+
+static int sensor_cadence_get(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf) {
+    return sensor_cadence_send(model, ctx, net_buf_simple_pull_le16(buf));
+}
+
+/**
+ * @brief Parse and apply a Sensor Cadence Set
+ *
+ * @param buf message parameters
+ * @param property returned property id
+ * @return int error code, the message is ignored on error
+ */
+static int sensor_cadence_apply(struct net_buf_simple *buf, uint16_t *property) {
+    struct mesh_channel *ch;
+    struct mesh_channel c;
+    k_spinlock_key_t key;
+    uint8_t delta_size, flags;
+
+    *property = net_buf_simple_pull_le16(buf);
+    ch = mesh_channel_find(*property);
+    if (ch == NULL || buf->len < 1) {
+        return -ENOENT;
+    }
+    c = *ch;
+    flags = net_buf_simple_pull_u8(buf);
+    c.divisor = flags & 0x7F;
+    c.percent = flags >> 7;
+    delta_size = c.percent ? 2 : c.size;
+    if (c.divisor > DIVISOR_MAX || buf->len != 2 * delta_size + 1 + 2 * c.size) {
+        return -EINVAL;
+    }
+    c.delta_down = (uint32_t) mesh_value_pull(buf, delta_size, false);
+    c.delta_up = (uint32_t) mesh_value_pull(buf, delta_size, false);
+    c.min_interval = net_buf_simple_pull_u8(buf);
+    c.fast_low = mesh_value_pull(buf, c.size, c.is_signed);
+    c.fast_high = mesh_value_pull(buf, c.size, c.is_signed);
+    if (c.min_interval > MIN_INTERVAL_MAX) {
+        return -EINVAL;
+    }
+
+    key = k_spin_lock(&lock);
+    ch->divisor = c.divisor;
+    ch->percent = c.percent;
+    ch->delta_down = c.delta_down;
+    ch->delta_up = c.delta_up;
+    ch->min_interval = c.min_interval;
+    ch->fast_low = c.fast_low;
+    ch->fast_high = c.fast_high;
+    k_spin_unlock(&lock, key);
+    return 0;
+}
+
+static int sensor_cadence_set(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf) {
+    uint16_t property;
+    int err = sensor_cadence_apply(buf, &property);
+
+    if (err == -EINVAL) {
+        return err;
+    }
+    return sensor_cadence_send(model, ctx, property);
+}
+
+static int sensor_cadence_set_unack(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf) {
+    uint16_t property;
+
+    return sensor_cadence_apply(buf, &property) == -EINVAL ? -EINVAL : 0;
+}
+#endif
+
+#ifdef CONFIG_APP_MESH_ROLE_SINK
+static int sensor_status(struct bt_mesh_model *model, struct bt_mesh_msg_ctx *ctx, struct net_buf_simple *buf) {
+    stats.received++;
+    mesh_log("rx", ctx->addr, buf->data, buf->len);
+    return 0;
+}
+
+static const struct bt_mesh_model_op sensor_cli_op[] = {
+    {OP_SENSOR_STATUS, BT_MESH_LEN_MIN(0), sensor_status},
+    BT_MESH_MODEL_OP_END,
+};
+#else
+static const struct bt_mesh_model_op sensor_srv_op[] = {
+    {OP_SENSOR_DESCRIPTOR_GET, BT_MESH_LEN_MIN(0), sensor_descriptor_get},
+    {OP_SENSOR_GET, BT_MESH_LEN_MIN(0), sensor_get},
+    BT_MESH_MODEL_OP_END,
+};
+
+static const struct bt_mesh_model_op sensor_setup_op[] = {
+    {OP_SENSOR_CADENCE_GET, BT_MESH_LEN_EXACT(2), sensor_cadence_get},
+    {OP_SENSOR_CADENCE_SET, BT_MESH_LEN_MIN(2), sensor_cadence_set},
+    {OP_SENSOR_CADENCE_SET_UNACK, BT_MESH_LEN_MIN(2), sensor_cadence_set_unack},
+    BT_MESH_MODEL_OP_END,
+};
+#endif
+
+static struct bt_mesh_cfg_cli cfg_cli;
+static struct bt_mesh_health_srv health_srv;
+BT_MESH_HEALTH_PUB_DEFINE(health_pub, 0);
+
+static struct bt_mesh_model root_models[] = {
+    BT_MESH_MODEL_CFG_SRV,
+    BT_MESH_MODEL_CFG_CLI(&cfg_cli),
+    BT_MESH_MODEL_HEALTH_SRV(&health_srv, &health_pub),
+#ifdef CONFIG_APP_MESH_ROLE_SINK
+    BT_MESH_MODEL(BT_MESH_MODEL_ID_SENSOR_CLI, sensor_cli_op, NULL, NULL),
+#else
+    BT_MESH_MODEL(BT_MESH_MODEL_ID_SENSOR_SRV, sensor_srv_op, &sensor_pub, NULL),
+    BT_MESH_MODEL(BT_MESH_MODEL_ID_SENSOR_SETUP_SRV, sensor_setup_op, NULL, NULL),
+#endif
+};
+
+static struct bt_mesh_elem elements[] = {
+    BT_MESH_ELEM(0, root_models, BT_MESH_MODEL_NONE),
+};
+
+static const struct bt_mesh_comp comp = {
+    .cid = COMPANY_ID,
+    .elem = elements,
+    .elem_count = ARRAY_SIZE(elements),
+};
+
+static void prov_complete(uint16_t net_idx, uint16_t addr) {
+    printk("mesh: provisioned, address 0x%04x\n", addr);
+#ifdef CONFIG_APP_MESH_ROLE_LPN
+    bt_mesh_lpn_set(true);
+#endif
+}
+
+static void prov_reset(void) {
+    bt_mesh_prov_enable(BT_MESH_PROV_ADV);
+}
+
+static const struct bt_mesh_prov prov = {
+    .uuid = dev_uuid,
+    .complete = prov_complete,
+    .reset = prov_reset,
+};
+
+/**
+ * @brief Keep the latest measures and publish on a status trigger
+ *
+ * Called by the encoder after each batch.
+ *
+ * @param value latest value of each pipeline channel
+ */
+void mesh_sensor_update(const int32_t *value) {
+    int64_t now = k_uptime_get();
+    bool trigger = false;
+    uint8_t divisor = 0;
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    for (int i = 0; i < NB_CHANNEL; i++) {
+        struct mesh_channel *ch = &channel[i];
+        int64_t delta, down = ch->delta_down, up = ch->delta_up;
+        bool fast;
+
+        ch->value = mesh_raw(ch, value);
+        if ((uint32_t) ch->value == ch->unknown) {
+            continue;
+        }
+        // fast cadence inside [low, high], or outside [high, low] when high < low
+        fast = ch->fast_low <= ch->fast_high ? ch->value >= ch->fast_low && ch->value <= ch->fast_high
+                                             : ch->value > ch->fast_low || ch->value < ch->fast_high;
+        if (fast) {
+            divisor = MAX(divisor, ch->divisor);
+        }
+        if (ch->published_at == 0) {
+            trigger = true;   // first known value
+            continue;
+        }
+        if (now - ch->published_at < BIT(ch->min_interval)) {
+            continue;   // at most one status per minimum interval
+        }
+        delta = (int64_t) ch->value - ch->published;
+        if (ch->percent) {
+            down = llabs(ch->published) * down / 10000;
+            up = llabs(ch->published) * up / 10000;
+        }
+        if ((delta > 0 && delta >= up) || (delta < 0 && -delta >= down)) {
+            trigger = true;
+        }
+    }
+    sensor_pub.period_div = divisor;
+    sensor_pub.fast_period = divisor > 0;
+    stats.fast = divisor > 0;
+    k_spin_unlock(&lock, key);
+
+    if (trigger) {
+        k_work_submit(&publish_work);
+    }
+}
+
+/**
+ * @brief Get the mesh activity
+ *
+ * @param s pointer to returned statistics
+ */
+void mesh_sensor_get(mesh_sensor_stats_t *s) {
+    *s = stats;
+}
+
+#ifdef CONFIG_APP_MESH_SELF_PROVISION
+/**
+ * @brief Unicast address from the identity address
+ *
+ * @return uint16_t CONFIG_APP_MESH_NODE_ADDR, or 0x0001 to 0x7FFE
+ */
+static uint16_t mesh_node_addr(void) {
+    bt_addr_le_t id;
+    size_t count = 1;
+
+    if (CONFIG_APP_MESH_NODE_ADDR) {
+        return CONFIG_APP_MESH_NODE_ADDR;
+    }
+    bt_id_get(&id, &count);
+    return 1 + sys_get_le16(id.a.val) % 0x7FFE;
+}
+
+/**
+ * @brief Provision with the built-in keys and configure the models
+ *
+ * Uses the local configuration client, so it blocks on the configuration
+ * server answers and must not run from the system work queue.
+ *
+ * @return int error code
+ */
+static int mesh_self_provision(void) {
+    uint16_t addr = mesh_node_addr();
+    uint8_t status = 0;
+    int err;
+
+    err = bt_mesh_provision(net_key, NET_IDX, 0, 0, addr, dev_key);
+    if (err == -EALREADY) {
+        return 0;   // restored from settings
+    } else if (err) {
+        return err;
+    }
+    bt_mesh_cfg_app_key_add(NET_IDX, addr, NET_IDX, APP_IDX, app_key, &status);
+    for (int i = FIRST_SENSOR_MODEL; i < ARRAY_SIZE(root_models); i++) {
+        bt_mesh_cfg_mod_app_bind(NET_IDX, addr, addr, APP_IDX, root_models[i].id, &status);
+    }
+#ifdef CONFIG_APP_MESH_ROLE_SINK
+    err = bt_mesh_cfg_mod_sub_add(NET_IDX, addr, addr, CONFIG_APP_MESH_GROUP, BT_MESH_MODEL_ID_SENSOR_CLI, &status);
+#else
+    struct bt_mesh_cfg_mod_pub pub = {
+        .addr = CONFIG_APP_MESH_GROUP,
+        .app_idx = APP_IDX,
+        .ttl = CONFIG_APP_MESH_TTL,
+        .period = CONFIG_APP_MESH_PUB_PERIOD_S < 64 ? BT_MESH_PUB_PERIOD_SEC(CONFIG_APP_MESH_PUB_PERIOD_S)
+                                                     : BT_MESH_PUB_PERIOD_10SEC(CONFIG_APP_MESH_PUB_PERIOD_S / 10),
+        .transmit = BT_MESH_PUB_TRANSMIT(1, 50),   // interval in 50 ms steps
+    };
+
+    err = bt_mesh_cfg_mod_pub_set(NET_IDX, addr, addr, BT_MESH_MODEL_ID_SENSOR_SRV, &pub, &status);
+#endif
+    if (err || status) {
+        printk("mesh: configuration failed (err %d, status 0x%02x)\n", err, status);
+        return err ? err : -EIO;
+    }
+    prov_complete(NET_IDX, addr);
+    return 0;
+}
+#endif
+
+/**
+ * @brief Initialize the mesh stack, then provision or wait for a provisioner
+ *
+ * Called from the main thread once Bluetooth is enabled.
+ *
+ * @return int error code
+ */
+int mesh_sensor_start(void) {
+    bt_addr_le_t id;
+    size_t count = 1;
+    bool restored;
+    int err;
+
+    k_work_init(&publish_work, mesh_publish);
+    bt_id_get(&id, &count);
+    memcpy(&dev_uuid[2], id.a.val, sizeof(id.a.val));
+
+    err = bt_mesh_init(&prov, &comp);
+    if (err) {
+        printk("mesh: init failed (err %d)\n", err);
+        return err;
+    }
+    if (IS_ENABLED(CONFIG_BT_SETTINGS)) {
+        settings_load_subtree("bt");
+    }
+    restored = bt_mesh_is_provisioned();
+#ifdef CONFIG_APP_MESH_SELF_PROVISION
+    err = mesh_self_provision();
+#else
+    if (!bt_mesh_is_provisioned()) {
+        err = bt_mesh_prov_enable(BT_MESH_PROV_ADV);
+    }
+#endif
+    if (err) {
+        printk("mesh: provisioning failed (err %d)\n", err);
+        return err;
+    }
+    if (restored) {
+        // prov_complete() only runs when the node is provisioned, not when it is restored
+        printk("mesh: restored from settings\n");
+#ifdef CONFIG_APP_MESH_ROLE_LPN
+        err = bt_mesh_lpn_set(true);
+        if (err) {
+            printk("mesh: low power mode failed (err %d)\n", err);
+        }
+#endif
+    }
+    return err;
+}
+
+#ifdef CONFIG_APP_MESH_ROLE_SINK
+/**
+ * @brief Sink role: only the mesh, no sensor
+ *
+ * @return int error code
+ */
+int mesh_sink_start(void) {
+    int err;
+
+    printk("Starting BTHome mesh sink\n");
+    err = bt_enable(NULL);
+    if (err) {
+        printk("Bluetooth init failed (err %d)\n", err);
+        return err;
+    }
+    return mesh_sensor_start();
+}
+#endif
+
+#endif
@@ -0,0 +1,814 @@
+/** @file
+ *  @brief Acquisition pipeline code
+ *
+ *  Sensor threads push samples into a bounded message queue. The encoder
+ *  thread drains it, keeps the latest value of each channel and publishes
+ *  one advertising payload per batch. A low priority telemetry thread
+ *  prints the measures and the pipeline statistics.
+ *
+ *  A button event is published with the batch that carries it and starts
+ *  an advertising burst. It stays in the payload for the burst duration.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <bluetooth/bluetooth.h>
+#include <kernel.h>
+#include <string.h>
+#include <sys/atomic.h>
+#include <sys/printk.h>
+
+#include <adv.h>
+#include <am2320.h>
+#include <app_config.h>
+#include <bmp180.h>
+#include <bthome.h>
+#include <button_event.h>
+#include <derived.h>
+#include <fusion.h>
+#include <led.h>
+#include <led_pattern.h>
+#include <mesh_sensor.h>
+#include <pipeline.h>
+#include <sampling.h>
+#include <trace.h>
+
+#define SENSOR_STACK    1024
+#define SENSOR_PRIO     5
+#define ENCODER_STACK   1024
+#define ENCODER_PRIO    2
+#define TELEMETRY_STACK 1024
+#define TELEMETRY_PRIO  14
+
+#define ADVERTISED(channels, ch) ((channels) & BIT(APP_CONFIG_##ch))
+#define OBJECT(channels, ch, size) (ADVERTISED(channels, ch) ? (size) : 0)
+
+// Largest service data of a channel mask: UUID, device information and every object with its id
+#define PAYLOAD_SIZE(channels)                                                                                                \
+    (3 + (IS_ENABLED(CONFIG_APP_BUTTON) ? 2 + 2 : 0) + OBJECT(channels, TEMPERATURE, 3) + OBJECT(channels, PRESSURE, 4) +     \
+     (IS_ENABLED(CONFIG_APP_FUSION) ? 0 : OBJECT(channels, TEMPERATURE2, 3)) + OBJECT(channels, HUMIDITY, 3) +                \
+     (IS_ENABLED(CONFIG_APP_BATTERY) ? OBJECT(channels, BATTERY, 2 + 3) : 0) +                                                \
+     (IS_ENABLED(CONFIG_APP_DERIVED) ? OBJECT(channels, DEW_POINT, 3) + OBJECT(channels, SEA_PRESSURE, 4) + OBJECT(channels, ALTITUDE, 3) \
+                                     : 0))
+
+BUILD_ASSERT(AM2320_INVALID == PIPELINE_UNSET, "a failed AM2320 read must leave its channels unset");
+BUILD_ASSERT(PAYLOAD_SIZE(APP_CONFIG_CHANNELS_DEFAULT) <= ADV_SERVICE_DATA_MAX, "CONFIG_APP_CHANNELS does not fit in the advertising payload");
+
+#define PAYLOAD_OBJECTS_MAX (ADV_SERVICE_DATA_MAX / 2)   // every object takes 2 bytes at least
+
+/**
+ * @struct pipeline_object
+ * @brief One BTHome object selected for the payload.
+ * */
+typedef struct pipeline_object {
+    uint8_t id;
+    int32_t value;
+} pipeline_object_t;
+
+/**
+ * @struct pipeline_payload
+ * @brief Objects selected for the payload, in priority order.
+ * */
+typedef struct pipeline_payload {
+    pipeline_object_t object[PAYLOAD_OBJECTS_MAX];
+    uint8_t count;
+    uint8_t room;   // bytes left for objects and their ids
+    bool full;      // an object did not fit, the following ones are dropped
+} pipeline_payload_t;
+
+#ifdef CONFIG_APP_CYCLE_BENCH
+#define SAMPLE_PERIOD_MS 0
+#else
+#define SAMPLE_PERIOD_MS BT_GAP_ADV_SLOW_INT_MIN
+#endif
+
+K_MSGQ_DEFINE(sample_q, sizeof(pipeline_sample_t), CONFIG_APP_PIPELINE_QUEUE_DEPTH, 4);
+static struct k_spinlock push_lock;
+
+static int32_t latest[PIPELINE_CHANNEL_COUNT];   // written by the encoder only
+static struct k_spinlock latest_lock;
+static atomic_t acquiring;
+static uint32_t nb_dropped;
+static uint32_t nb_coalesced;
+static uint32_t max_depth;
+static uint32_t nb_batches;
+static uint32_t nb_objects_dropped;   // objects left out of a full payload, written by the encoder only
+K_SEM_DEFINE(bmp180_wake, 0, 1);   // given to cut the BMP180 period short
+K_SEM_DEFINE(am2320_wake, 0, 1);   // given to cut the AM2320 period short
+static struct k_sem *const sensor_wake[SAMPLING_SENSOR_COUNT] = {
+    [SAMPLING_BMP180] = &bmp180_wake,
+    [SAMPLING_AM2320] = &am2320_wake,
+};
+#ifdef CONFIG_APP_FUSION
+static atomic_t am2320_slowdown = ATOMIC_INIT(1);   // AM2320 period in SAMPLE_PERIOD_MS units
+static uint32_t am2320_saved;                        // AM2320 reads skipped while the fusion was stable
+#endif
+#ifdef CONFIG_APP_BUTTON
+static uint8_t packet_id;     // written by the encoder only
+static int64_t button_until;  // uptime when the button event leaves the payload, 0 when none
+#endif
+
+static void sensor_bmp180(void *p1, void *p2, void *p3);
+static void sensor_am2320(void *p1, void *p2, void *p3);
+static void encoder(void *p1, void *p2, void *p3);
+#ifdef CONFIG_APP_TELEMETRY
+static void telemetry(void *p1, void *p2, void *p3);
+#endif
+
+K_THREAD_DEFINE(bmp180_tid, SENSOR_STACK, sensor_bmp180, NULL, NULL, NULL, SENSOR_PRIO, 0, SYS_FOREVER_MS);
+K_THREAD_DEFINE(am2320_tid, SENSOR_STACK, sensor_am2320, NULL, NULL, NULL, SENSOR_PRIO, 0, SYS_FOREVER_MS);
+K_THREAD_DEFINE(encoder_tid, ENCODER_STACK, encoder, NULL, NULL, NULL, ENCODER_PRIO, 0, SYS_FOREVER_MS);
+#ifdef CONFIG_APP_TELEMETRY
+K_THREAD_DEFINE(telemetry_tid, TELEMETRY_STACK, telemetry, NULL, NULL, NULL, TELEMETRY_PRIO, 0, SYS_FOREVER_MS);
+#endif
+
+/**
+ * @brief Show the sensor activity on the acquisition LED
+ *
+ * With the pattern engine a read starts a short flash, otherwise the LED
+ * stays on while at least one sensor is read.
+ *
+ * @param on true when a read starts, false when it ends
+ */
+static void acquiring_led(bool on) {
+#ifdef CONFIG_APP_LED_PATTERN
+    if (on && atomic_inc(&acquiring) == 0) {
+        led_pattern_set(LED_PATTERN_ACQUIRING, true);
+    } else if (!on) {
+        atomic_dec(&acquiring);
+    }
+#else
+    if (on) {
+        if (atomic_inc(&acquiring) == 0) {
+            led_set(2, true);
+        }
+    } else if (atomic_dec(&acquiring) == 1) {
+        led_set(2, false);
+    }
+#endif
+}
+
+/**
+ * @brief Merge the queued samples so each channel appears at most once
+ *
+ * Called with push_lock held when the queue is full, at most
+ * CONFIG_APP_PIPELINE_QUEUE_DEPTH samples are moved.
+ */
+static void pipeline_coalesce(void) {
+    pipeline_sample_t merged[PIPELINE_CHANNEL_COUNT];
+    pipeline_sample_t sample;
+    bool present[PIPELINE_CHANNEL_COUNT] = {false};
+
+    while (k_msgq_get(&sample_q, &sample, K_NO_WAIT) == 0) {
+        if (present[sample.channel]) {
+            nb_coalesced++;
+        }
+        merged[sample.channel] = sample;
+        present[sample.channel] = true;
+    }
+    for (int i = 0; i < PIPELINE_CHANNEL_COUNT; i++) {
+        if (present[i]) {
+            k_msgq_put(&sample_q, &merged[i], K_NO_WAIT);
+        }
+    }
+}
+
+/**
+ * @brief Queue a sample for the encoder, never blocks
+ *
+ * The queue operations never wait and push_lock is a spinlock, so a
+ * sensor thread cannot hold up the button work queue.
+ *
+ * @param channel enum pipeline_channel
+ * @param value measure
+ * @param timestamp k_cycle_get_32() when the read started
+ */
+void pipeline_push(uint8_t channel, int32_t value, uint32_t timestamp) {
+    pipeline_sample_t sample = {.timestamp = timestamp, .channel = channel, .value = value};
+    pipeline_sample_t oldest;
+    uint32_t depth;
+    k_spinlock_key_t key = k_spin_lock(&push_lock);
+
+    while (k_msgq_put(&sample_q, &sample, K_NO_WAIT) != 0) {
+        if (IS_ENABLED(CONFIG_APP_PIPELINE_COALESCE) && k_msgq_num_used_get(&sample_q) > PIPELINE_CHANNEL_COUNT) {
+            pipeline_coalesce();
+        } else if (k_msgq_get(&sample_q, &oldest, K_NO_WAIT) == 0) {
+            nb_dropped++;
+        }
+    }
+    depth = k_msgq_num_used_get(&sample_q);
+    max_depth = MAX(max_depth, depth);
+    k_spin_unlock(&push_lock, key);
+}
+
+/**
+ * @brief Delay between two reads of a sensor
+ *
+ * @param sensor sensor just read
+ * @return int32_t delay in ms
+ */
+static int32_t pipeline_period_ms(enum sampling_sensor sensor) {
+    int32_t period = SAMPLE_PERIOD_MS;
+
+#if defined(CONFIG_APP_CONFIG) && !defined(CONFIG_APP_CYCLE_BENCH)
+    period = app_config_get()->period_ms;
+#endif
+#ifdef CONFIG_APP_SAMPLING_ADAPTIVE
+    period = MAX(period, sampling_next(sensor));   // the configured period is the floor
+#endif
+    return period;
+}
+
+/**
+ * @brief Channels to advertise
+ *
+ * @return uint32_t BIT(enum app_config_channel) set when advertised
+ */
+static uint32_t pipeline_channels(void) {
+#ifdef CONFIG_APP_CONFIG
+    return app_config_get()->channels;
+#else
+    return APP_CONFIG_CHANNELS_DEFAULT;
+#endif
+}
+
+/**
+ * @brief BMP180 oversampling for the next read
+ *
+ * A read stands for the whole sensor period. While the adaptive sampler
+ * runs at its shortest period the pressure moves faster than the noise of
+ * the lowest setting; each doubling of the period allows one more
+ * oversampling step, up to the configured ceiling.
+ *
+ * @return enum _bmp180_oversampling_settings setting
+ */
+static enum _bmp180_oversampling_settings pipeline_oversampling(void) {
+#ifdef CONFIG_APP_CONFIG
+    uint8_t ceiling = app_config_get()->oversampling;
+#else
+    uint8_t ceiling = CONFIG_APP_BMP180_OVERSAMPLING;
+#endif
+#ifdef CONFIG_APP_SAMPLING_ADAPTIVE
+    sampling_stats_t sampling;
+    uint8_t oss = ultra_low_power;
+
+    uint32_t period;
+
+    sampling_get(SAMPLING_BMP180, &sampling);
+    period = sampling.period;
+#ifdef CONFIG_APP_CONFIG
+    period = MAX(period, app_config_get()->period_ms);
+#endif
+    for (uint32_t ratio = period / CONFIG_APP_SAMPLING_MIN_MS; ratio > 1 && oss < ceiling; ratio >>= 1) {
+        oss++;
+    }
+    return oss;
+#else
+    return ceiling;
+#endif
+}
+
+/**
+ * @brief Wait for the end of a sensor period
+ *
+ * Only this wait can be cut short: a k_wakeup() would also end the waits
+ * inside the drivers, before the sensor has finished its conversion.
+ *
+ * @param wake semaphore given to read the sensor right away
+ * @param ms sensor period
+ */
+static void pipeline_sleep(struct k_sem *wake, int32_t ms) {
+    TRACE_BEGIN(TRACE_STAGE_SLEEP);
+    k_sem_take(wake, K_MSEC(ms));
+    TRACE_END(TRACE_STAGE_SLEEP);
+}
+
+/**
+ * @brief Read sensors now instead of at the end of their period
+ *
+ * @param sensors BIT(enum sampling_sensor) of the sensors to read
+ */
+static void pipeline_wake(uint32_t sensors) {
+    for (int i = 0; i < SAMPLING_SENSOR_COUNT; i++) {
+        if (sensors & BIT(i)) {
+            k_sem_give(sensor_wake[i]);
+        }
+    }
+}
+
+#ifdef CONFIG_APP_FUSION
+/**
+ * @brief Delay between two AM2320 reads
+ *
+ * The fusion slowdown multiplies the sampling period, with adaptive
+ * sampling the product is capped to the longest adaptive period.
+ *
+ * @return int32_t delay in ms
+ */
+static int32_t pipeline_am2320_period_ms(void) {
+    int32_t period = pipeline_period_ms(SAMPLING_AM2320);
+    int32_t slowed = period * atomic_get(&am2320_slowdown);
+
+    if (period == 0) {
+        return 0;   // APP_CYCLE_BENCH: back to back reads, nothing saved
+    }
+#ifdef CONFIG_APP_SAMPLING_ADAPTIVE
+    slowed = MIN(slowed, MAX(period, CONFIG_APP_SAMPLING_MAX_MS));
+#endif
+    am2320_saved += slowed / period - 1;
+    return slowed;
+}
+#endif
+
+static void sensor_bmp180(void *p1, void *p2, void *p3) {
+    for (;;) {
+        uint32_t start = k_cycle_get_32();
+        int32_t pressure, temp;
+
+        bmp180_setOversampling(pipeline_oversampling());
+        acquiring_led(true);
+        TRACE_BEGIN(TRACE_STAGE_BMP180);
+        pressure = bmp180_readPressure();
+        temp = bmp180_readTemperature();
+        TRACE_END(TRACE_STAGE_BMP180);
+        acquiring_led(false);
+        pipeline_push(PIPELINE_PRESSURE, pressure, start);
+        pipeline_push(PIPELINE_TEMP, temp, start);
+
+        pipeline_sleep(&bmp180_wake, pipeline_period_ms(SAMPLING_BMP180));
+    }
+}
+
+static void sensor_am2320(void *p1, void *p2, void *p3) {
+    for (;;) {
+        uint32_t start = k_cycle_get_32();
+        int32_t temp2, humidity;
+
+        acquiring_led(true);
+        TRACE_BEGIN(TRACE_STAGE_AM2320);
+        temp2 = am2320_readTemperature();
+        humidity = am2320_readHumidity();
+        TRACE_END(TRACE_STAGE_AM2320);
+        acquiring_led(false);
+        pipeline_push(PIPELINE_TEMP2, temp2, start);
+        pipeline_push(PIPELINE_HUMIDITY, humidity, start);
+#ifdef CONFIG_APP_LED_PATTERN
+        led_pattern_set(LED_PATTERN_ERROR, temp2 == AM2320_INVALID || humidity == AM2320_INVALID);
+#endif
+
+#ifdef CONFIG_APP_FUSION
+        // The BMP180 keeps the fused estimate up to date, the encoder wakes us up on a change
+        pipeline_sleep(&am2320_wake, pipeline_am2320_period_ms());
+#else
+        pipeline_sleep(&am2320_wake, pipeline_period_ms(SAMPLING_AM2320));
+#endif
+    }
+}
+
+#ifdef CONFIG_APP_DERIVED
+/**
+ * @brief Compute the derived channels from the latest measures
+ *
+ * @param value latest value of each channel, derived channels updated
+ */
+static void pipeline_derive(int32_t *value) {
+    // The dew point and the absolute humidity keep their value when the AM2320 read fails
+    if (value[PIPELINE_TEMP2] != AM2320_INVALID && value[PIPELINE_HUMIDITY] != AM2320_INVALID) {
+        value[PIPELINE_DEW_POINT] = derived_dew_point(value[PIPELINE_TEMP2], value[PIPELINE_HUMIDITY]);
+        value[PIPELINE_ABS_HUMIDITY] = derived_abs_humidity(value[PIPELINE_TEMP2], value[PIPELINE_HUMIDITY]);
+    }
+    if (value[PIPELINE_PRESSURE] > 0) {
+        value[PIPELINE_ALTITUDE] = derived_altitude(value[PIPELINE_PRESSURE], DERIVED_SEA_LEVEL_PA);
+        value[PIPELINE_SEA_PRESSURE] = derived_sea_pressure(value[PIPELINE_PRESSURE], CONFIG_APP_STATION_ALTITUDE * 10);
+    }
+}
+#endif
+
+/**
+ * @brief Select one object while the payload has room
+ *
+ * Objects are offered in priority order: the first one that does not fit
+ * closes the payload and it and every following object are dropped.
+ *
+ * @param payload objects selected so far
+ * @param id BTHome object id
+ * @param value value in the object unit, PIPELINE_UNSET is left out
+ */
+static void pipeline_add(pipeline_payload_t *payload, uint8_t id, int32_t value) {
+    int size = 1 + bthome_object_size(id);
+
+    if (value == PIPELINE_UNSET) {
+        return;
+    }
+    if (payload->full || size > payload->room) {
+        payload->full = true;
+        nb_objects_dropped++;
+        return;
+    }
+    payload->room -= size;
+    payload->object[payload->count].id = id;
+    payload->object[payload->count].value = value;
+    payload->count++;
+}
+
+/**
+ * @brief Write the latest measures in the BTHome service data
+ *
+ * Objects are selected by priority, in the order below: once the
+ * advertising packet is full the remaining ones are left out and counted.
+ * Channels removed from the configured mask and unset channels (not
+ * measured yet, failed AM2320 read) are left out. The selected objects are
+ * then written in ascending object id, as BTHome v2 requires; objects with
+ * the same id keep their priority order.
+ *
+ * @param service_data payload buffer of ADV_SERVICE_DATA_MAX bytes
+ * @param value latest value of each channel
+ * @return size_t service data size
+ */
+static size_t pipeline_encode(uint8_t *service_data, const int32_t *value) {
+    uint32_t channels = pipeline_channels();
+    pipeline_payload_t payload = {0};
+    bthome_buf_t buf;
+
+    bthome_begin(&buf, service_data, ADV_SERVICE_DATA_MAX);
+    payload.room = buf.size - buf.len;
+#ifdef CONFIG_APP_BUTTON
+    pipeline_add(&payload, BTHOME_PACKET_ID, packet_id);
+    if (value[PIPELINE_BUTTON] != BTHOME_BUTTON_NONE) {
+        pipeline_add(&payload, BTHOME_BUTTON, value[PIPELINE_BUTTON]);
+    }
+#endif
+#ifdef CONFIG_APP_FUSION
+    if (ADVERTISED(channels, TEMPERATURE)) {
+        pipeline_add(&payload, BTHOME_TEMPERATURE, value[PIPELINE_TEMP_FUSED]);
+    }
+    if (ADVERTISED(channels, PRESSURE)) {
+        pipeline_add(&payload, BTHOME_PRESSURE, value[PIPELINE_PRESSURE]);
+    }
+#else
+    if (ADVERTISED(channels, TEMPERATURE)) {
+        pipeline_add(&payload, BTHOME_TEMPERATURE, value[PIPELINE_TEMP]);
+    }
+    if (ADVERTISED(channels, PRESSURE)) {
+        pipeline_add(&payload, BTHOME_PRESSURE, value[PIPELINE_PRESSURE]);
+    }
+    if (ADVERTISED(channels, TEMPERATURE2)) {
+        pipeline_add(&payload, BTHOME_TEMPERATURE, value[PIPELINE_TEMP2]);
+    }
+#endif
+    if (ADVERTISED(channels, HUMIDITY)) {
+        pipeline_add(&payload, BTHOME_HUMIDITY, value[PIPELINE_HUMIDITY]);
+    }
+#ifdef CONFIG_APP_BATTERY
+    if (ADVERTISED(channels, BATTERY)) {
+        pipeline_add(&payload, BTHOME_BATTERY, value[PIPELINE_BATTERY]);
+        pipeline_add(&payload, BTHOME_VOLTAGE, value[PIPELINE_VOLTAGE]);
+    }
+#endif
+#ifdef CONFIG_APP_DERIVED
+    if (ADVERTISED(channels, DEW_POINT)) {
+        pipeline_add(&payload, BTHOME_DEW_POINT, value[PIPELINE_DEW_POINT]);
+    }
+    if (ADVERTISED(channels, SEA_PRESSURE)) {
+        pipeline_add(&payload, BTHOME_PRESSURE, value[PIPELINE_SEA_PRESSURE]);
+    }
+    if (ADVERTISED(channels, ALTITUDE) && value[PIPELINE_ALTITUDE] != PIPELINE_UNSET) {
+        pipeline_add(&payload, BTHOME_DISTANCE_M, MAX(value[PIPELINE_ALTITUDE], 0));
+    }
+#endif
+
+    // Stable insertion sort by id, the payload holds a dozen objects at most
+    for (int i = 1; i < payload.count; i++) {
+        pipeline_object_t object = payload.object[i];
+        int j = i;
+
+        for (; j > 0 && payload.object[j - 1].id > object.id; j--) {
+            payload.object[j] = payload.object[j - 1];
+        }
+        payload.object[j] = object;
+    }
+    for (int i = 0; i < payload.count; i++) {
+        bthome_add(&buf, payload.object[i].id, payload.object[i].value);
+    }
+    return buf.len;
+}
+
+#ifdef CONFIG_APP_FUSION
+/**
+ * @brief Feed a temperature sample to the fusion filter
+ *
+ * @param sample sample taken from the queue
+ * @param value latest value of each channel, fused channel updated
+ */
+static void pipeline_fuse(const pipeline_sample_t *sample, int32_t *value) {
+    if (sample->channel == PIPELINE_TEMP) {
+        value[PIPELINE_TEMP_FUSED] = fusion_update(FUSION_BMP180, sample->value, k_uptime_get());
+    } else if (sample->channel == PIPELINE_TEMP2 && sample->value != AM2320_INVALID) {
+        value[PIPELINE_TEMP_FUSED] = fusion_update(FUSION_AM2320, sample->value, k_uptime_get());
+        if (fusion_stable()) {
+            // one more period between AM2320 reads per consistent read
+            if (atomic_get(&am2320_slowdown) < CONFIG_APP_FUSION_MAX_SLOWDOWN) {
+                atomic_inc(&am2320_slowdown);
+            }
+            return;
+        }
+    } else {
+        return;
+    }
+    if (!fusion_stable() && atomic_set(&am2320_slowdown, 1) > 1) {
+        pipeline_wake(BIT(SAMPLING_AM2320));   // read the AM2320 again right away
+    }
+}
+#endif
+
+#ifdef CONFIG_APP_BUTTON
+/**
+ * @brief Keep a button event in the payload for the advertising burst only
+ *
+ * The packet id changes with every payload except while an event is
+ * advertised, so receivers filtering on the packet id report the event
+ * once. Measures published during the burst are delayed by the same filter.
+ *
+ * @param value latest value of each channel, button channel cleared once the burst is over
+ * @param event true when the batch carried a new event
+ */
+static void pipeline_button(int32_t *value, bool event) {
+    int64_t now = k_uptime_get();
+
+    if (event) {
+        button_until = now + CONFIG_APP_BUTTON_BURST_MS;
+    } else if (button_until != 0 && now < button_until) {
+        return;
+    } else {
+        value[PIPELINE_BUTTON] = BTHOME_BUTTON_NONE;
+        button_until = 0;
+    }
+    packet_id++;
+}
+#endif
+
+#ifdef CONFIG_APP_CYCLE_BENCH
+/**
+ * @brief Accumulate the sample to publication latency and report
+ *
+ * @param start k_cycle_get_32() value of the oldest sample of the batch
+ */
+static void cycle_bench(uint32_t start) {
+    static uint32_t count;
+    static uint32_t min_us = UINT32_MAX;
+    static uint32_t max_us;
+    static uint64_t total_us;
+    static uint32_t window_start;
+    uint32_t now = k_cycle_get_32();
+    uint32_t us = k_cyc_to_us_floor32(now - start);
+    uint32_t window_us;
+
+    if (count == 0) {
+        window_start = start;
+    }
+    min_us = MIN(min_us, us);
+    max_us = MAX(max_us, us);
+    total_us += us;
+    if (++count < CONFIG_APP_CYCLE_BENCH_COUNT) {
+        return;
+    }
+    window_us = MAX(k_cyc_to_us_floor32(now - window_start), 1);
+    printk("bench: %u cycles, %u.%02u cycles/s, latency min %u us avg %u us max %u us\n", count, (uint32_t) (100000000ULL * count / window_us / 100),
+           (uint32_t) (100000000ULL * count / window_us % 100), min_us, (uint32_t) (total_us / count), max_us);
+    count = 0;
+    min_us = UINT32_MAX;
+    max_us = 0;
+    total_us = 0;
+}
+#endif
+
+static void encoder(void *p1, void *p2, void *p3) {
+    pipeline_sample_t sample;
+    int32_t value[PIPELINE_CHANNEL_COUNT];
+
+    // Nothing is advertised for a channel until its sensor has pushed it
+    for (int i = 0; i < PIPELINE_CHANNEL_COUNT; i++) {
+        value[i] = PIPELINE_UNSET;
+    }
+    value[PIPELINE_BUTTON] = BTHOME_BUTTON_NONE;
+
+    for (;;) {
+        uint32_t oldest;
+        size_t len;
+        k_spinlock_key_t key;
+#ifdef CONFIG_APP_BUTTON
+        bool button = false;
+        uint32_t button_since = 0;
+#endif
+
+        k_msgq_get(&sample_q, &sample, K_FOREVER);
+        oldest = sample.timestamp;
+        do {
+            value[sample.channel] = sample.value;
+#ifdef CONFIG_APP_BUTTON
+            if (sample.channel == PIPELINE_BUTTON) {
+                button = true;
+                button_since = sample.timestamp;
+            }
+#endif
+#ifdef CONFIG_APP_SAMPLING_ADAPTIVE
+            pipeline_wake(sampling_update(sample.channel, sample.value, k_uptime_get()));
+#endif
+#ifdef CONFIG_APP_FUSION
+            pipeline_fuse(&sample, value);
+#endif
+            if ((int32_t) (sample.timestamp - oldest) < 0) {
+                oldest = sample.timestamp;
+            }
+        } while (k_msgq_get(&sample_q, &sample, K_NO_WAIT) == 0);
+
+        TRACE_BEGIN(TRACE_STAGE_ENCODE);
+#ifdef CONFIG_APP_DERIVED
+        pipeline_derive(value);
+#endif
+#ifdef CONFIG_APP_BUTTON
+        pipeline_button(value, button);
+#endif
+        len = pipeline_encode(adv_payload_next(), value);
+        TRACE_END(TRACE_STAGE_ENCODE);
+        adv_payload_publish(len);
+#ifdef CONFIG_APP_MESH
+        mesh_sensor_update(value);
+#endif
+#ifdef CONFIG_APP_BUTTON
+        if (button) {
+            adv_burst(button_since);
+        }
+#endif
+        nb_batches++;
+#ifdef CONFIG_APP_TRACE
+        trace_end(TRACE_STAGE_CYCLE, oldest);
+#endif
+#ifdef CONFIG_APP_CYCLE_BENCH
+        cycle_bench(oldest);
+#endif
+
+        key = k_spin_lock(&latest_lock);
+        memcpy(latest, value, sizeof(latest));
+        k_spin_unlock(&latest_lock, key);
+    }
+}
+
+#ifdef CONFIG_APP_TELEMETRY
+#ifdef CONFIG_THREAD_RUNTIME_STATS
+/**
+ * @brief Print the CPU share of a thread since the previous call
+ *
+ * @param name thread name
+ * @param tid thread id
+ * @param last execution cycles at the previous call, updated
+ * @param elapsed cycles elapsed since the previous call
+ */
+static void telemetry_thread(const char *name, k_tid_t tid, uint64_t *last, uint64_t elapsed) {
+    k_thread_runtime_stats_t rt;
+
+    k_thread_runtime_stats_get(tid, &rt);
+    printk("  %-9s : %u.%u %% cpu\n", name, (uint32_t) ((rt.execution_cycles - *last) * 100 / elapsed),
+           (uint32_t) ((rt.execution_cycles - *last) * 1000 / elapsed % 10));
+    *last = rt.execution_cycles;
+}
+#endif
+
+static void telemetry(void *p1, void *p2, void *p3) {
+    int32_t value[PIPELINE_CHANNEL_COUNT];
+#ifdef CONFIG_THREAD_RUNTIME_STATS
+    static uint64_t last[4];
+    uint32_t last_cycle = k_cycle_get_32();
+#endif
+
+    for (;;) {
+        k_spinlock_key_t key;
+
+        k_sleep(K_MSEC(BT_GAP_ADV_SLOW_INT_MIN));
+
+        key = k_spin_lock(&latest_lock);
+        memcpy(value, latest, sizeof(value));
+        k_spin_unlock(&latest_lock, key);
+
+        TRACE_BEGIN(TRACE_STAGE_LOG);
+        printk("temperature   : %u\n", value[PIPELINE_TEMP]);
+        printk("pression      : %u\n", value[PIPELINE_PRESSURE]);
+        printk("temperature 2 : %u\n", value[PIPELINE_TEMP2]);
+        printk("humidity      : %u\n", value[PIPELINE_HUMIDITY]);
+#ifdef CONFIG_APP_BATTERY
+        printk("battery       : %u mV, %u %%\n", value[PIPELINE_VOLTAGE], value[PIPELINE_BATTERY]);
+#endif
+#ifdef CONFIG_APP_FUSION
+        fusion_stats_t fusion;
+
+        fusion_get(&fusion);
+        printk("fused temp    : %d, variance %u, bias %d/%d, %u rejected, %u steps, %u am2320 reads saved\n", fusion.temperature,
+               fusion.variance, fusion.bias[FUSION_BMP180], fusion.bias[FUSION_AM2320], fusion.rejected, fusion.steps, am2320_saved);
+#endif
+#ifdef CONFIG_APP_LED_PATTERN
+        led_pattern_stats_t led;
+
+        led_pattern_get(&led);
+        printk("led           : %u wake-ups/h, %u ms on/h\n", (uint32_t) ((uint64_t) led.wakeups * MSEC_PER_SEC * 3600 / MAX(led.uptime_ms, 1)),
+               (uint32_t) ((uint64_t) led.on_ms * MSEC_PER_SEC * 3600 / MAX(led.uptime_ms, 1)));
+#endif
+#ifdef CONFIG_APP_BUTTON
+        button_stats_t button;
+        adv_latency_t latency;
+
+        button_event_get(&button);
+        adv_latency_get(&latency);
+        printk("button        : %u edges, %u bounces, %u press, %u double, %u long\n", button.edges, button.bounces, button.press,
+               button.double_press, button.long_press);
+        printk("button to air : %u events, min %u us avg %u us max %u us, %u late\n", latency.count, latency.min, latency.avg, latency.max,
+               latency.late);
+#endif
+#ifdef CONFIG_APP_DERIVED
+        printk("dew point     : %d\n", value[PIPELINE_DEW_POINT]);
+        printk("abs humidity  : %d\n", value[PIPELINE_ABS_HUMIDITY]);
+        printk("altitude      : %d\n", value[PIPELINE_ALTITUDE]);
+        printk("sea pressure  : %d\n", value[PIPELINE_SEA_PRESSURE]);
+#endif
+#ifdef CONFIG_APP_SAMPLING_ADAPTIVE
+        sampling_stats_t sampling;
+
+        sampling_get(SAMPLING_BMP180, &sampling);
+        printk("bmp180 period : %u ms, %u reads, %u skipped\n", sampling.period, sampling.reads, sampling.skipped);
+        sampling_get(SAMPLING_AM2320, &sampling);
+        printk("am2320 period : %u ms, %u reads, %u skipped\n", sampling.period, sampling.reads, sampling.skipped);
+#endif
+#ifdef CONFIG_APP_MESH
+        mesh_sensor_stats_t mesh;
+
+        mesh_sensor_get(&mesh);
+        printk("mesh          : %u periodic, %u on change, %u replies%s\n", mesh.periodic, mesh.triggered, mesh.replies,
+               mesh.fast ? ", fast cadence" : "");
+#endif
+        bmp180_conversion_t conversion;
+
+        bmp180_conversion_get(&conversion);
+        printk("bmp180 conv   : %u, avg %u us (fixed sleep %u us), max %u us, %u polls, %u timeouts\n", conversion.count, conversion.avg_us,
+               conversion.fixed_us, conversion.max_us, conversion.polls, conversion.timeouts);
+        printk("queue         : %u/%u used, max %u, %u dropped, %u coalesced, %u batches\n", k_msgq_num_used_get(&sample_q),
+               CONFIG_APP_PIPELINE_QUEUE_DEPTH, max_depth, nb_dropped, nb_coalesced, nb_batches);
+        printk("payload       : %u objects dropped, no room left\n", nb_objects_dropped);
+#ifdef CONFIG_THREAD_RUNTIME_STATS
+        uint32_t now = k_cycle_get_32();
+        uint64_t elapsed = MAX(now - last_cycle, 1);
+
+        telemetry_thread("bmp180", bmp180_tid, &last[0], elapsed);
+        telemetry_thread("am2320", am2320_tid, &last[1], elapsed);
+        telemetry_thread("encoder", encoder_tid, &last[2], elapsed);
+        telemetry_thread("telemetry", telemetry_tid, &last[3], elapsed);
+        last_cycle = now;
+#endif
+        TRACE_END(TRACE_STAGE_LOG);
+    }
+}
+#endif
+
+/**
+ * @brief Prepare the advertising payload buffers
+ *
+ * @return int error code
+ */
+int pipeline_init(void) {
+    uint8_t service_data[ADV_SERVICE_DATA_MAX];
+    bthome_buf_t buf;
+
+    k_thread_name_set(bmp180_tid, "bmp180");
+    k_thread_name_set(am2320_tid, "am2320");
+    k_thread_name_set(encoder_tid, "encoder");
+#ifdef CONFIG_APP_TELEMETRY
+    k_thread_name_set(telemetry_tid, "telemetry");
+#endif
+    bthome_begin(&buf, service_data, sizeof(service_data));
+    return adv_init(service_data, buf.len);
+}
+
+/**
+ * @brief Read the sensors now instead of at the end of their period
+ *
+ * A read in progress, BMP180 conversion and AM2320 wake-up included, is
+ * never cut short: the sensors skip the rest of their current period only.
+ */
+void pipeline_wakeup(void) {
+    pipeline_wake(BIT_MASK(SAMPLING_SENSOR_COUNT));
+}
+
+/**
+ * @brief Start the sensor, encoder and telemetry threads
+ *
+ */
+void pipeline_start(void) {
+    k_thread_start(encoder_tid);
+    k_thread_start(bmp180_tid);
+    k_thread_start(am2320_tid);
+#ifdef CONFIG_APP_TELEMETRY
+    k_thread_start(telemetry_tid);
+#endif
+}
@@ -0,0 +1,133 @@
+/** @file
+ *  @brief Adaptive sampling code
+ *
+ *  Each channel tracks a smoothed rate of change. The period of a channel
+ *  grows while the change expected over one period stays well under the
+ *  channel tolerance, shrinks when it exceeds it, and falls back to the
+ *  minimum on a step. A sensor is read at the shortest period of its
+ *  channels, and every sensor is read right away when one sees a step.
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <kernel.h>
+#include <stdlib.h>
+#include <sys/atomic.h>
+
+#include <am2320.h>
+#include <pipeline.h>
+#include <sampling.h>
+
+#ifdef CONFIG_APP_SAMPLING_ADAPTIVE
+
+#define PERIOD_MIN  CONFIG_APP_SAMPLING_MIN_MS
+#define PERIOD_MAX  CONFIG_APP_SAMPLING_MAX_MS
+#define RATE_SHIFT  2   // smoothing of the rate, 1/4 of the new value
+#define STEP_FACTOR 4   // a change above STEP_FACTOR tolerances is a step
+
+struct sampling_channel {
+    uint8_t sensor;
+    int32_t tolerance;   // change acceptable between two samples, channel unit
+    int32_t last;
+    int64_t last_time;
+    int32_t rate;        // smoothed |change| per second, channel unit << 8
+    uint32_t period;     // ms
+    bool valid;
+};
+
+static struct sampling_channel channel[] = {
+    [PIPELINE_TEMP] = {.sensor = SAMPLING_BMP180, .tolerance = 10},       // 0.1 degC
+    [PIPELINE_PRESSURE] = {.sensor = SAMPLING_BMP180, .tolerance = 10},   // 10 Pa
+    [PIPELINE_TEMP2] = {.sensor = SAMPLING_AM2320, .tolerance = 10},      // 0.1 degC
+    [PIPELINE_HUMIDITY] = {.sensor = SAMPLING_AM2320, .tolerance = 50},   // 0.5 %RH
+};
+
+static atomic_t period[SAMPLING_SENSOR_COUNT] = {ATOMIC_INIT(PERIOD_MIN), ATOMIC_INIT(PERIOD_MIN)};
+static uint32_t reads[SAMPLING_SENSOR_COUNT];
+static uint32_t skipped[SAMPLING_SENSOR_COUNT];
+
+/**
+ * @brief Feed a new value of a channel
+ *
+ * @param ch enum pipeline_channel, other channels are ignored
+ * @param value measure, AM2320_INVALID is ignored
+ * @param now uptime in ms
+ * @return uint32_t BIT(enum sampling_sensor) of the sensors to read now, all of them on a step, 0 otherwise
+ */
+uint32_t sampling_update(uint8_t ch, int32_t value, int64_t now) {
+    struct sampling_channel *c;
+    uint32_t sensor_period = PERIOD_MAX;
+    int32_t delta, rate;
+    int64_t expected;
+    uint32_t wake = 0;
+
+    if (ch >= ARRAY_SIZE(channel) || value == AM2320_INVALID) {
+        return 0;
+    }
+    c = &channel[ch];
+    if (!c->valid || now <= c->last_time) {
+        c->last = value;
+        c->last_time = now;
+        c->period = PERIOD_MIN;
+        c->valid = true;
+        return 0;
+    }
+
+    delta = abs(value - c->last);
+    rate = (int32_t) (((int64_t) delta << 8) * 1000 / (now - c->last_time));
+    c->rate += (rate - c->rate) >> RATE_SHIFT;
+    c->last = value;
+    c->last_time = now;
+
+    expected = ((int64_t) c->rate * c->period / 1000) >> 8;
+    if (delta > STEP_FACTOR * c->tolerance) {
+        c->period = PERIOD_MIN;
+        // Every sensor may sleep for up to PERIOD_MAX, the one that stepped
+        // included: its thread picked its period before this update ran
+        wake = BIT_MASK(SAMPLING_SENSOR_COUNT);
+    } else if (expected > c->tolerance) {
+        c->period = MAX(c->period * 3 / 4, PERIOD_MIN);
+    } else if (expected < c->tolerance / 2) {
+        c->period = MIN(c->period * 5 / 4, PERIOD_MAX);
+    }
+
+    for (int i = 0; i < ARRAY_SIZE(channel); i++) {
+        if (channel[i].sensor == c->sensor) {
+            sensor_period = MIN(sensor_period, channel[i].valid ? channel[i].period : PERIOD_MIN);
+        }
+    }
+    atomic_set(&period[c->sensor], sensor_period);
+    return wake;
+}
+
+/**
+ * @brief Account for a read and get the delay before the next one
+ *
+ * @param sensor sensor just read
+ * @return uint32_t period in ms
+ */
+uint32_t sampling_next(enum sampling_sensor sensor) {
+    uint32_t p = atomic_get(&period[sensor]);
+
+    reads[sensor]++;
+    skipped[sensor] += p / PERIOD_MIN - 1;
+    return p;
+}
+
+/**
+ * @brief Get the sampling activity of a sensor
+ *
+ * @param sensor sensor
+ * @param stats pointer to returned statistics
+ */
+void sampling_get(enum sampling_sensor sensor, sampling_stats_t *stats) {
+    stats->period = atomic_get(&period[sensor]);
+    stats->reads = reads[sensor];
+    stats->skipped = skipped[sensor];
+}
+
+#endif
@@ -0,0 +1,285 @@
+/** @file
+ *  @brief Acquisition loop tracing code
+ */
+
+/*
+ * Copyright (c) 2023 BARTHELEMY Stéphane
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <kernel.h>
+#include <string.h>
+#include <sys/byteorder.h>
+#include <sys/printk.h>
+
+#ifdef CONFIG_APP_TRACE_SHELL
+#include <shell/shell.h>
+#endif
+#ifdef CONFIG_APP_TRACE_CTF
+#include <tracing/tracing_format.h>
+#endif
+
+#include <trace.h>
+
+#ifdef CONFIG_APP_TRACE
+
+// Log-linear histogram: 4 buckets per power of two, from 1 us to ~16 s
+#define SUB_BITS  2
+#define NB_SUB    (1 << SUB_BITS)
+#define NB_BUCKET 96
+
+#define CTF_EVENT_BEGIN 0x01
+#define CTF_EVENT_END   0x02
+
+struct trace_hist {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint16_t bucket[NB_BUCKET];
+};
+
+static const char *const stage_name[TRACE_STAGE_COUNT] = {"cycle", "bmp180", "am2320", "wait", "log", "encode", "adv", "sleep"};
+
+static struct trace_hist hist[TRACE_STAGE_COUNT];
+static struct k_spinlock lock;
+
+/**
+ * @brief Histogram bucket of a duration
+ *
+ * @param us duration in us
+ * @return int bucket index
+ */
+static int trace_bucket(uint32_t us) {
+    int msb;
+
+    if (us < NB_SUB) {
+        return us;
+    }
+    msb = 31 - __builtin_clz(us);
+    return MIN((msb - SUB_BITS + 1) * NB_SUB + ((us >> (msb - SUB_BITS)) & (NB_SUB - 1)), NB_BUCKET - 1);
+}
+
+/**
+ * @brief Upper bound of a histogram bucket
+ *
+ * @param idx bucket index
+ * @return uint32_t largest duration in us falling in the bucket
+ */
+static uint32_t trace_bucket_max(int idx) {
+    int msb;
+
+    if (idx < NB_SUB) {
+        return idx;
+    }
+    msb = idx / NB_SUB + SUB_BITS - 1;
+    return ((uint32_t) (NB_SUB + idx % NB_SUB + 1) << (msb - SUB_BITS)) - 1;
+}
+
+#ifdef CONFIG_APP_TRACE_CTF
+static struct k_spinlock ctf_lock;
+
+/**
+ * @brief Emit a stage event in the layout of zephyr/trace/metadata
+ *
+ * The 32 bit cycle counter is extended to 64 bits, so the events of a
+ * stream must be less than one counter wrap apart (the sleep stage ends
+ * at least once per sensor period). The counter is read and the event
+ * written under the lock to keep the stream timestamps monotonic.
+ *
+ * @param id CTF_EVENT_BEGIN or CTF_EVENT_END
+ * @param stage stage index
+ */
+static void trace_ctf(uint8_t id, enum trace_stage stage) {
+    static uint32_t last;
+    static uint64_t high;
+    struct __packed {
+        uint64_t timestamp;
+        uint8_t id;
+        uint8_t stage;
+    } event = {
+        .id = id,
+        .stage = stage,
+    };
+    k_spinlock_key_t key = k_spin_lock(&ctf_lock);
+    uint32_t now = k_cycle_get_32();
+
+    if (now < last) {
+        high += 1ULL << 32;
+    }
+    last = now;
+    event.timestamp = k_cyc_to_ns_floor64(high | now);
+    tracing_format_raw_data((uint8_t *) &event, sizeof(event));
+    k_spin_unlock(&ctf_lock, key);
+}
+#endif
+
+/**
+ * @brief Start timing a stage
+ *
+ * @param stage stage index
+ * @return uint32_t start timestamp, to give back to trace_end()
+ */
+uint32_t trace_begin(enum trace_stage stage) {
+    uint32_t now = k_cycle_get_32();
+
+#ifdef CONFIG_APP_TRACE_CTF
+    trace_ctf(CTF_EVENT_BEGIN, stage);
+#endif
+    return now;
+}
+
+/**
+ * @brief Stop timing a stage and record its duration
+ *
+ * @param stage stage index
+ * @param start value returned by trace_begin()
+ */
+void trace_end(enum trace_stage stage, uint32_t start) {
+    uint32_t now = k_cycle_get_32();
+    uint32_t us = k_cyc_to_us_floor32(now - start);
+    struct trace_hist *h = &hist[stage];
+    k_spinlock_key_t key = k_spin_lock(&lock);
+    int idx = trace_bucket(us);
+
+    if (h->count == 0 || us < h->min) {
+        h->min = us;
+    }
+    if (us > h->max) {
+        h->max = us;
+    }
+    h->count++;
+    if (h->bucket[idx] < UINT16_MAX) {
+        h->bucket[idx]++;
+    }
+    k_spin_unlock(&lock, key);
+
+#ifdef CONFIG_APP_TRACE_CTF
+    trace_ctf(CTF_EVENT_END, stage);
+#endif
+}
+
+/**
+ * @brief Percentile of a histogram, clamped to the exact min/max
+ */
+static uint32_t trace_percentile(const struct trace_hist *h, uint32_t total, uint32_t percent) {
+    uint32_t rank = (total * percent + 99) / 100;
+    uint32_t seen = 0;
+
+    for (int i = 0; i < NB_BUCKET; i++) {
+        seen += h->bucket[i];
+        if (seen >= rank) {
+            return CLAMP(trace_bucket_max(i), h->min, h->max);
+        }
+    }
+    return h->max;
+}
+
+/**
+ * @brief Get the statistics of a stage
+ *
+ * @param stage stage index
+ * @param stats pointer to returned statistics
+ */
+void trace_get(enum trace_stage stage, trace_stats_t *stats) {
+    struct trace_hist h;
+    uint32_t total = 0;
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    memcpy(&h, &hist[stage], sizeof(h));
+    k_spin_unlock(&lock, key);
+
+    for (int i = 0; i < NB_BUCKET; i++) {
+        total += h.bucket[i];
+    }
+    stats->count = h.count;
+    stats->min = h.min;
+    stats->max = h.max;
+    stats->p50 = total ? trace_percentile(&h, total, 50) : 0;
+    stats->p99 = total ? trace_percentile(&h, total, 99) : 0;
+}
+
+/**
+ * @brief Name of a stage
+ *
+ * @param stage stage index
+ * @return const char* stage name
+ */
+const char *trace_stage_name(enum trace_stage stage) {
+    return stage_name[stage];
+}
+
+/**
+ * @brief Serialize all stage statistics
+ *
+ * Layout: version, stage count, then count/min/max/p50/p99 per stage as
+ * little endian uint32.
+ *
+ * @param buf output buffer
+ * @param len size of buf, at least TRACE_DUMP_SIZE
+ * @return size_t number of bytes written, 0 if buf is too small
+ */
+size_t trace_dump(uint8_t *buf, size_t len) {
+    trace_stats_t stats;
+    uint8_t *p = buf;
+
+    if (len < TRACE_DUMP_SIZE) {
+        return 0;
+    }
+    *p++ = TRACE_DUMP_VERSION;
+    *p++ = TRACE_STAGE_COUNT;
+    for (int i = 0; i < TRACE_STAGE_COUNT; i++) {
+        trace_get(i, &stats);
+        sys_put_le32(stats.count, p);
+        sys_put_le32(stats.min, p + 4);
+        sys_put_le32(stats.max, p + 8);
+        sys_put_le32(stats.p50, p + 12);
+        sys_put_le32(stats.p99, p + 16);
+        p += sizeof(trace_stats_t);
+    }
+    return p - buf;
+}
+
+/**
+ * @brief Clear all histograms
+ *
+ */
+void trace_reset(void) {
+    k_spinlock_key_t key = k_spin_lock(&lock);
+
+    memset(hist, 0, sizeof(hist));
+    k_spin_unlock(&lock, key);
+}
+
+#ifdef CONFIG_APP_TRACE_SHELL
+static int cmd_trace_stats(const struct shell *shell, size_t argc, char **argv) {
+    trace_stats_t stats;
+
+    shell_print(shell, "%-8s %8s %8s %8s %8s %8s", "stage", "count", "min", "p50", "p99", "max");
+    for (int i = 0; i < TRACE_STAGE_COUNT; i++) {
+        trace_get(i, &stats);
+        shell_print(shell, "%-8s %8u %8u %8u %8u %8u", stage_name[i], stats.count, stats.min, stats.p50, stats.p99, stats.max);
+    }
+    return 0;
+}
+
+static int cmd_trace_dump(const struct shell *shell, size_t argc, char **argv) {
+    uint8_t buf[TRACE_DUMP_SIZE];
+    size_t len = trace_dump(buf, sizeof(buf));
+
+    shell_hexdump(shell, buf, len);
+    return 0;
+}
+
+static int cmd_trace_reset(const struct shell *shell, size_t argc, char **argv) {
+    trace_reset();
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_trace, SHELL_CMD(stats, NULL, "Per stage latency in us", cmd_trace_stats),
+                               SHELL_CMD(dump, NULL, "Binary statistics dump", cmd_trace_dump), SHELL_CMD(reset, NULL, "Clear statistics", cmd_trace_reset),
+                               SHELL_SUBCMD_SET_END);
+SHELL_CMD_REGISTER(trace, &sub_trace, "Acquisition loop tracing", NULL);
+#endif
+
+#endif
@@ -0,0 +1,125 @@
+# Mesh scenario report: end-to-end latency and radio duty cycle.
+#
+# Reads the runs of mesh_scenario.sh, one directory per node count holding
+# the device logs (d<n>.log, device 0 is the sink), the roles file and the
+# phy dumps (d_2G4_<n>.Tx.csv and .Rx.csv).
+#
+# Latency: every "mesh rx <src> <status> <us>" line of the sink is matched
+# with the latest "mesh tx" line of the same source and status sent before
+# it (CONFIG_APP_MESH_LOG). Delivery is the share of the publications that
+# reached the sink at least once.
+#
+# Duty cycle: time the radio spends transmitting (start_time to end_time)
+# and receiving (start_time to the packet end, the abort or the end of the
+# scan) over the simulated time. Rx includes the scanner windows, so relays
+# sit close to 100 % and the LPN figure is the one to watch.
+
+import argparse
+import bisect
+import csv
+import os
+import re
+import statistics
+
+LOG_RE = re.compile(r"mesh (tx|rx) ([0-9a-f]{4}) ([0-9a-f]*) (\d+)")
+ADDR_RE = re.compile(r"mesh: provisioned, address 0x([0-9a-f]{4})")
+
+
+def read_log(path):
+    addr, events = None, []
+    with open(path, errors="replace") as f:
+        for line in f:
+            m = ADDR_RE.search(line)
+            if m:
+                addr = int(m.group(1), 16)
+                continue
+            m = LOG_RE.search(line)
+            if m:
+                events.append((m.group(1), int(m.group(2), 16), m.group(3), int(m.group(4))))
+    return addr, events
+
+
+def percentile(values, p):
+    if not values:
+        return 0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(p * len(values)))]
+
+
+def radio_time(path, rx):
+    if not os.path.exists(path):
+        return 0
+    busy = 0
+    with open(path) as f:
+        for row in csv.DictReader(f):
+            start = int(row["start_time"])
+            if not rx:
+                end = int(row["end_time"])
+            else:
+                end = start + int(row.get("scan_duration", 0))
+                stamp = int(row.get("rx_time_stamp") or 0)
+                abort = int(row.get("abort_time") or 0)
+                if stamp > start:
+                    end = min(end, stamp)
+                if start < abort < end:
+                    end = abort
+            busy += max(0, end - start)
+    return busy
+
+
+def report(run, seconds):
+    roles = open(os.path.join(run, "roles")).read().strip().split(",")
+    sink_addr, sink_events = read_log(os.path.join(run, "d0.log"))
+
+    # (src, status) -> sorted publication times
+    sent, nodes = {}, []
+    for dev in range(1, len(roles)):
+        addr, events = read_log(os.path.join(run, "d%u.log" % dev))
+        nodes.append((dev, roles[dev], addr))
+        for kind, src, status, us in events:
+            if kind == "tx":
+                sent.setdefault((src, status), []).append(us)
+
+    latency, delivered = [], set()
+    for kind, src, status, us in sink_events:
+        times = sent.get((src, status))
+        if kind != "rx" or not times:
+            continue
+        i = bisect.bisect_right(times, us) - 1
+        if i >= 0:
+            latency.append(us - times[i])
+            delivered.add((src, status, times[i]))
+    published = sum(len(v) for v in sent.values())
+
+    n = len(roles) - 1
+    print("%u nodes, sink 0x%04x" % (n, sink_addr or 0))
+    print("  publications %u, delivered %.1f %%" % (published, 100.0 * len(delivered) / published if published else 0))
+    if latency:
+        print("  latency ms: p50 %.1f  p99 %.1f  max %.1f  mean %.1f" %
+              (percentile(latency, 0.5) / 1000, percentile(latency, 0.99) / 1000, max(latency) / 1000, statistics.mean(latency) / 1000))
+
+    total = seconds * 1000000
+    duty = {}
+    print("  %-4s %-6s %-6s %8s %8s" % ("dev", "role", "addr", "tx %", "rx %"))
+    for dev, role, addr in [(0, roles[0], sink_addr)] + nodes:
+        tx = 100.0 * radio_time(os.path.join(run, "d_2G4_%u.Tx.csv" % dev), False) / total
+        rx = 100.0 * radio_time(os.path.join(run, "d_2G4_%u.Rx.csv" % dev), True) / total
+        duty.setdefault(role, []).append((tx, rx))
+        print("  %-4u %-6s %-6s %8.3f %8.3f" % (dev, role, "%04x" % addr if addr else "-", tx, rx))
+    for role, values in sorted(duty.items()):
+        print("  %-11s mean tx %.3f %%, rx %.3f %%" %
+              (role, statistics.mean(v[0] for v in values), statistics.mean(v[1] for v in values)))
+    print()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="BabbleSim mesh scenario report")
+    parser.add_argument("--seconds", type=int, default=300, help="simulated time of the runs")
+    parser.add_argument("runs", nargs="+", help="run directories of mesh_scenario.sh")
+    args = parser.parse_args()
+    for run in args.runs:
+        report(run, args.seconds)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,80 @@
+#!/usr/bin/env bash
+# BabbleSim mesh scenario: one sink and N sensor nodes on a line, every
+# LPN_EVERY-th node a low power node polling its relay neighbour. Each run
+# logs every device and dumps the radio activity, then mesh_report.py prints
+# the end-to-end latency and the per node radio duty cycle for each N.
+#
+# Needs west, BabbleSim built in BSIM_OUT_PATH and BSIM_COMPONENTS_PATH set.
+#
+#   zephyr/bsim/mesh_scenario.sh [N ...]     default: 4 8 16 32
+#
+# SIM_S (simulated seconds, 300), LPN_EVERY (4, 0 for none), HOP_DB (path
+# loss between neighbours, 50) and FAR_DB (beyond one hop, 90) tune the run.
+
+set -eu
+
+: "${BSIM_OUT_PATH:?BabbleSim is not set up}"
+
+HERE=$(cd "$(dirname "$0")" && pwd)
+APP=$(dirname "$HERE")
+BUILD=${BUILD:-$APP/../build-bsim}
+OUT=${OUT:-$BUILD/results}
+SIM_S=${SIM_S:-300}
+LPN_EVERY=${LPN_EVERY:-4}
+HOP_DB=${HOP_DB:-50}
+FAR_DB=${FAR_DB:-90}
+BIN=$BSIM_OUT_PATH/bin
+NODES=("$@")
+[ ${#NODES[@]} -eq 0 ] && NODES=(4 8 16 32)
+
+build() {
+    west build -p auto -b nrf52_bsim -d "$BUILD/$1" "$APP" -- -DOVERLAY_CONFIG="$2" > "$BUILD/$1.log"
+    cp "$BUILD/$1/zephyr/zephyr.exe" "$BIN/bs_nrf52_bthome_mesh_$1"
+}
+
+mkdir -p "$BUILD" "$OUT"
+build relay "mesh.conf;bsim/scenario.conf"
+build lpn "mesh.conf;mesh_lpn.conf;bsim/scenario.conf"
+build sink "mesh.conf;mesh_sink.conf;bsim/scenario.conf"
+
+for n in "${NODES[@]}"; do
+    id=bthome_mesh_$n
+    dir=$OUT/$n
+    count=$((n + 1))
+    mkdir -p "$dir"
+
+    # Device 0 is the sink at the head of the line, device i is i hops away
+    # from it when only neighbours hear each other.
+    att=$dir/att.txt
+    : > "$att"
+    for ((a = 0; a < count; a++)); do
+        for ((b = 0; b < count; b++)); do
+            [ $a -eq $b ] && continue
+            d=$((a > b ? a - b : b - a))
+            echo "$a $b : $([ $d -eq 1 ] && echo "$HOP_DB" || echo "$FAR_DB")" >> "$att"
+        done
+    done
+
+    roles=sink
+    cd "$BIN"
+    ./bs_nrf52_bthome_mesh_sink -s="$id" -d=0 -rs=1 > "$dir/d0.log" 2>&1 &
+    for ((i = 1; i <= n; i++)); do
+        role=relay
+        # An LPN needs a relay (friend) next to it, never the last node
+        if [ "$LPN_EVERY" -gt 0 ] && [ $((i % LPN_EVERY)) -eq 0 ] && [ $i -lt $n ]; then
+            role=lpn
+        fi
+        roles=$roles,$role
+        ./bs_nrf52_bthome_mesh_$role -s="$id" -d=$i -rs=$((i + 1)) > "$dir/d$i.log" 2>&1 &
+    done
+    ./bs_2G4_phy_v1 -s="$id" -D=$count -sim_length=$((SIM_S * 1000000)) -dump \
+        -channel=multiatt -argschannel -at="$FAR_DB" -file="$att" -argsmain > "$dir/phy.log" 2>&1
+    wait
+    cd - > /dev/null
+
+    cp "$BSIM_OUT_PATH/results/$id"/d_2G4_*.csv "$dir/"
+
+    echo "$roles" > "$dir/roles"
+done
+
+python3 "$HERE/mesh_report.py" --seconds "$SIM_S" "${NODES[@]/#/$OUT/}"